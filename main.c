@@ -1,14 +1,71 @@
 
-#define F_CPU 12000000UL
+#ifndef F_CPU
+#define F_CPU 12000000UL	//normally set by Makefile, see default/Makefile
+#endif
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include <avr/wdt.h>
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
 #include<util/delay.h>
+#include <util/twi.h>
+#include <util/crc16.h>
 
 #include "usbdrv.h"
 #include "oddebug.h"
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						 HARDWARE ABSTRACTION						//
+//	Use:															//
+//		runs on ATmega8 and ATmega88/168/328, chosen by MCU in		//
+//		Makefile. registers named differently on the two families	//
+//		are used by the names below only. F_CPU must be a crystal	//
+//		rate of V-USB: 12, 15, 16 or 20MHz, ATmega8 only up to		//
+//		16MHz. all timings below are given in ms or us and turned	//
+//		into ticks of the clock used								//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#if FLASHEND < 0x1fff
+#error "needs 8K flash, ATmega8/88/168/328"
+#endif
+
+#if F_CPU!=12000000UL && F_CPU!=15000000UL && F_CPU!=16000000UL && F_CPU!=20000000UL
+#error "F_CPU must be a 12, 15, 16 or 20MHz crystal, other V-USB rates need osccal or crc code"
+#endif
+
+#if defined(EIMSK)			//ATmega88/168/328
+#define EXT_INT_CONTROL		EICRA
+#define EXT_INT_MASK		EIMSK
+#define EXT_INT_FLAGS		EIFR
+#define TIMER0_CONTROL		TCCR0B
+#define TIMER1_MASK			TIMSK1
+#define EEPROM_MASTER_WRITE	EEMPE
+#define EEPROM_WRITE		EEPE
+#define RESET_FLAGS			MCUSR
+#define PIN_CHANGE_WAKE		1		// every pad wakes from power-down, not only PD3
+#else						//ATmega8
+#define EXT_INT_CONTROL		MCUCR
+#define EXT_INT_MASK		GICR
+#define EXT_INT_FLAGS		GIFR
+#define TIMER0_CONTROL		TCCR0
+#define TIMER1_MASK			TIMSK
+#define EEPROM_MASTER_WRITE	EEMWE
+#define EEPROM_WRITE		EEWE
+#define RESET_FLAGS			MCUCSR
+#define PIN_CHANGE_WAKE		0
+#if F_CPU>16000000UL
+#error "ATmega8 is rated for 16MHz at most, 20MHz needs ATmega88/168/328"
+#endif
+#endif
+
+#define TICKS_MS(ms)		((ms)*(F_CPU/8000UL))			// timer1 ticks (F_CPU/8) in ms
+#define TICKS_US(us)		((us)*(F_CPU/1000UL)/8000UL)	// timer1 ticks in us, us < 350000
+
+//////////////////////////////////////////////////////////////////////
 
 #define MOD_CONTROL_LEFT    (1<<0)
 #define MOD_SHIFT_LEFT      (1<<1)
@@ -91,15 +148,35 @@ uint8_t xNegative = 0, xnegonTime = 0;
 uint8_t yPositive = 0, yposonTime = 0;
 uint8_t yNegative = 0, ynegonTime = 0;
 
-uint8_t mouseSpeed = 1;
-uint16_t mouseSpeedCounter = 0;
+uint16_t mouseSpeed = 0;		//counts per report, MOUSE_FRACTION_BITS fraction
+int16_t mouseFractionX = 0;		//motion not sent yet, MOUSE_FRACTION_BITS fraction
+int16_t mouseFractionY = 0;
+int8_t mouseWheel = 0;			//scroll not sent yet, goes out with next mouse report
+
+uint8_t swipeLast = 0;			//strip pad touched last
+uint32_t swipeTime = 0xffffffff;	//timer1 ticks since then, stops at SWIPE_TIMEOUT
+uint16_t swipeLastTime = 0;		//timer1 at last scan
+uint8_t mouseStep = 0;			//position in mouseCurve
+uint32_t mouseTime = 0;			//timer1 ticks since last step of mouseCurve
+uint16_t mouseLastTime = 0;		//timer1 at last scan
+uint8_t pointerTarget = 0;		//pad-11 whose absTarget is not sent yet, 0 = none
+
+uint16_t turboHeld = 0;			//turbo keys held, bit n-1 = key n
+uint8_t turboPhase = 0;			//1 = held turbo keys are down now
+uint8_t turboDirty = 0;			//phase or held keys changed, report not sent yet
+uint32_t turboTime = 0;			//timer1 ticks into current phase
+uint16_t turboLastTime = 0;		//timer1 at last scan
 
 uint8_t byteCounter=0,bitCounter=0;
+uint8_t baselineCounter=0;
+uint8_t ditherState=1;			//lfsr for scan period, must never be 0
+uint16_t idleScans=0;			//scans since last touched sample
+uint16_t scanPeriod=0;			//timer1 ticks until next scan, set by keyPressed()
 
-static uchar    reportBufferKeyboard[8];    /* buffer for HID keyboard reports */
-static uchar    reportBufferMouse[4];		/* buffer for HID Mouse reports */
 static uchar    idleRate;           /* in 4 ms units */
 
+uchar usbRemoteWakeup = 0;		//host allowed remote wakeup, set from usb driver hook
+
 //////////////////////////////////////////////////////////////////////
 
 
@@ -126,6 +203,73 @@ static uchar    idleRate;           /* in 4 ms units */
 #define RELEASE_THRESHOLD 	12	// threshold according to makey-makey
 #define PRESS_THRESHOLD 	14  // threshol according to makey-makey
 
+#define FILTER_EMA			0	// 1 = exponential average (1 byte per key) instead of 24 bit window
+#define EMA_SHIFT			3	// average moves 1/8 of the difference per scan
+
+#define ADAPTIVE_BASELINE	0	// 1 = thresholds of each key follow slow drift of its idle level
+#define BASELINE_SHIFT		10	// baseline moves 1/1024 of the difference per update
+#define BASELINE_DIVIDER	4	// update baseline every 4th scan (power of 2), ~3s time constant
+
+#define FAST_ATTACK			0	// 1 = press as soon as FAST_ATTACK_RUN touched samples come in a row
+#define FAST_ATTACK_RUN		6	// consecutive touched samples for fast press, release stays on filter
+
+#define CALIBRATE_ON_BOOT	0	// 1 = sample idle level of keys during usb reset delay
+
+#define BRIDGE_DETECT		0	// 1 = ignore pad pressed right after its pin neighbour with same samples
+#define BRIDGE_ONSET_SCANS	8	// neighbour was pressed at most 8 scans (~6ms) before
+#define BRIDGE_DIFF_BITS	2	// at most 2 of 24 samples differ, both pins are one wet spot
+#define VENDOR_RQ_GET_BRIDGES	7	//returns bridgeCount, ignored presses per pin pair
+
+#define SELFTEST_MASK		1	// 1 = inputs found shorted at power-up are not scanned
+#define SELFTEST_MASK_FLOATING	0	// 1 = floating ones neither, also drops pads touched at power-up
+#define SELFTEST_PULLUP_US	20	// internal pull-up on, or pin driven low, this long
+#define SELFTEST_RISE_MS	5	// 10M charges lead back up within this, ~5 time constants at 100pF
+
+#define CHATTER_GUARD		0	// 1 = key pressing too often gets wider hysteresis
+#define CHATTER_WINDOW_TICKS	TICKS_MS(1000UL)	// timer1 ticks (1s) per counting window
+#define CHATTER_BUDGET		15	// presses per window before hysteresis widens
+#define CHATTER_MAX_WIDEN	6	// release level goes at most 6 below normal
+#define VENDOR_RQ_GET_CHATTER	8	//returns struct chatter
+
+#define SCAN_TICKS			TICKS_US(744)	// timer1 ticks between scans, 1116 at 12MHz
+#define HUM_DITHER			1	// 1 = random scan period so 50/60Hz hum does not alias
+#define HUM_DITHER_TICKS	(TICKS_MS(1)*128/375)	// scan period moves +-341us (512 ticks at 12MHz), average stays SCAN_TICKS
+
+#define IDLE_SLEEP			1	// 1 = cpu sleeps (idle mode) until next task is due instead of busy wait
+#define IDLE_SCANS			6700	// scans without any touch before slow scanning, ~5s
+#define IDLE_SCAN_FACTOR	4		// scan period is 4 times longer while nobody touches, usbPoll() keeps its own task period
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					 ANALOG SENSING SETTINGS						//
+//	Use:															//
+//		PC0-PC5 are ADC0-ADC5. with ADC_SENSE they are read by the	//
+//		ADC instead of PINC, so pads with weak conductors (fruit,	//
+//		plants) which never pull the pin below logic low still		//
+//		count. one round of 6 conversions is started every scan		//
+//		and runs in ADC interrupt, result is used on next scan.		//
+//		all other pads stay on PINB/PIND							//
+//		ADC wants a source of 10k or less, pads are 10M. sample		//
+//		and hold (14pF) keeps charge of last channel and a touched	//
+//		0V pad would pull its neighbour down. first conversion(s)	//
+//		after each channel switch are thrown away, and 1nF from		//
+//		every ADC pad to GND holds the pad level so leftover charge	//
+//		moves reading by < 2%. without the capacitors raise			//
+//		ADC_DISCARD or lower pull-ups to 1M. with ADC_DISCARD 1 a	//
+//		round takes ~830us, scan which finds it running reuses the	//
+//		last values													//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#define ADC_SENSE			0	// 1 = PC0-PC5 read by ADC with threshold per pad
+#define ADC_TOUCH_DROP		24	// ADCH counts below idle level of a pad that count as touch
+#define ADC_PADS			6	// ADC0-ADC5, keys 7 to 12
+#define ADC_DISCARD			1	// conversions thrown away after each channel switch
+
+#define VENDOR_RQ_GET_ANALOG	6	//returns struct analog, last readings and thresholds
+
 //////////////////////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////////////////////
@@ -134,9 +278,194 @@ static uchar    idleRate;           /* in 4 ms units */
 //																	//
 //////////////////////////////////////////////////////////////////////
 
-#define MOUSE_SPEED 500			//according to my experimentation
+#define MOUSE_STEP_TICKS	TICKS_MS(100UL)	//timer1 ticks (100ms) per step of mouseCurve
+#define MOUSE_MAX_SPEED		20			//counts per report, must stay below 128
+#define MOUSE_FRACTION_BITS	4			//mouseCurve is in 1/16 counts per report
+#define MOUSE_INTENSITY		0			//1 = how full the filter window is scales speed
+#define MOUSE_ABSOLUTE		0			//1 = pads 12-15 put pointer on absTarget, no relative motion
+
+#define SWIPE_SCROLL		0			//1 = pads below are a scroll strip instead of keys
+#define SWIPE_FIRST			6			//first key of the strip, 6 = PC0
+#define SWIPE_PADS			6			//PC0 to PC5, must be next to each other in this order
+#define SWIPE_TIMEOUT		TICKS_MS(300UL)	//timer1 ticks (300ms) from one pad to next to count as swipe
 uint8_t button_state = 0;		//these variable is to enable click drag feature
 
+//report size follows MOUSE_ABSOLUTE, so buffers come after it
+static uchar    reportBufferKeyboard[8];    /* buffer for HID keyboard reports */
+#if MOUSE_ABSOLUTE
+static uchar    reportBufferMouse[6] = {2, 0, 0x00, 0x40, 0x00, 0x40};	/* id, buttons, x, y; starts at centre */
+#else
+static uchar    reportBufferMouse[5];		/* buffer for HID Mouse reports */
+#endif
+#if HID_GAMEPAD
+static uchar    reportBufferGamepad[3];		/* one bit per pad, pad 0 is bit 0 of byte 0 */
+#endif
+#if MOUSE_INTENSITY
+int8_t mouseRelease[4];			//release level of pads 12 to 15 in last scan
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					 		TURBO SETTINGS							//
+//	Use:															//
+//		held turbo key is pressed and released again and again.		//
+//		rate comes from timer1, not from scans, and late reports	//
+//		do not shift the next ones, so rate stays exact on average	//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#define TURBO_KEYS			0x000	// bit n-1 set = keyboard key n repeats while held, 0 = no turbo
+#define TURBO_HZ			10		// press/release pairs per second
+#define TURBO_HALF_TICKS	(TICKS_MS(1000UL)/(2*TURBO_HZ))	//timer1 ticks pressed, same released
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					 	BOARD LINK SETTINGS							//
+//	Use:															//
+//		more than 18 pads: secondary boards scan their pads and		//
+//		keep packed pressed bits ready on TWI (PC4 SDA, PC5 SCL,	//
+//		pads 10 and 11 are lost on every board). primary reads one	//
+//		board every LINK_PERIOD and sends their keys together with	//
+//		its own in one keyboard report. secondaries have no usb,	//
+//		power them from primary and not from a usb port.			//
+//		SDA and SCL need one 2.2k-4.7k pull-up each to 5V, fitted	//
+//		once for the whole bus. 10M pad pull-ups and internal ones	//
+//		are far too weak, bus would never rise and every read		//
+//		would time out. 100kHz suits cables between boards, with	//
+//		short ones and 2.2k pull-ups 400kHz (TWBR 7 at 12MHz) works	//
+//		latency on top of the filter is at most LINK_PERIOD *		//
+//		LINK_BOARDS (4ms) plus ~600us for the frame on the wire		//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#define LINK_NONE			0
+#define LINK_PRIMARY		1
+#define LINK_SECONDARY		2
+
+#define LINK_MODE			LINK_NONE	// NONE, PRIMARY or SECONDARY
+#define LINK_BOARDS			2		// secondaries read by primary, see linkKeymap
+#define LINK_ADDRESS		0x20	// TWI address of first secondary, others follow
+#define LINK_SELF			0		// secondary: this board answers on LINK_ADDRESS+LINK_SELF
+#define LINK_PERIOD			TICKS_MS(2)	// timer1 ticks (2ms) between reads, one board per read
+#define LINK_TIMEOUT		TICKS_US(250)	// timer1 ticks (250us) one TWI step may take, a byte is 90us
+#define LINK_LOST			20		// bad or unchanged frames in a row before board keys are released
+#define LINK_TWBR			((F_CPU/100000UL-15)/2)	// F_CPU/(16+2*TWBR) up to 100kHz, 52 at 12MHz
+#define LINK_FRAME			5		// sequence, 3 bytes pressed bits, crc8 of the 4 before
+
+#define VENDOR_RQ_GET_LINK	10		//returns struct linkStats of every board
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					 	INPUT EXPANSION SETTINGS					//
+//	Use:															//
+//		up to 64 more pads on a chain of 74HC165, each pad with		//
+//		its own 10M pull-up like the pads on the board. chain is	//
+//		read by hardware SPI: PB2 load (SH/LD), PB5 clock, PB4		//
+//		from QH of first chip, QH of every chip to SER of next.		//
+//		pads 2, 4 and 5 are lost for it. whole chain is latched at	//
+//		once and shifted in once per scan with interrupts on, so	//
+//		usb is never held off. 8 chips take ~90us at 750kHz			//
+//		expansion pads use the plain thresholds: no baseline		//
+//		tracking, no power-up self test, no bit in the enable mask.	//
+//		in suspend they wake the host only with SUSPEND_SLOW_SCAN	//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#define EXPAND_CHIPS		0		// 74HC165 in chain, 0 = none, at most 8
+#define EXPAND_PADS			(EXPAND_CHIPS*8)	// pad A of first chip is 0, H of last is EXPAND_PADS-1
+#define EXPAND_SPI			((1<<SPE)|(1<<MSTR)|(1<<SPR0))	// master, F_CPU/16 = 750kHz at 12MHz for long wires
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					 EEPROM CONFIGURATION SETTINGS					//
+//	Use:															//
+//		keymap, thresholds and input enable mask are kept in eeprom	//
+//		as a log of slots, every save goes to next slot so wear is	//
+//		spread over whole eeprom. bump CONFIG_VERSION whenever		//
+//		struct config changes so old slots are not loaded with		//
+//		wrong layout.												//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#define CONFIG_VERSION		2
+#define CONFIG_SLOT_SIZE	(sizeof(struct config) + 2)	//sequence + config + checksum
+#define CONFIG_SLOTS		((E2END + 1) / CONFIG_SLOT_SIZE)
+#define CONFIG_ERASED_SEQ	0xff	//sequence of never written slot
+
+#define VENDOR_RQ_GET_CONFIG		1	//returns struct config
+#define VENDOR_RQ_SET_KEY			2	//wIndex = key (1..NUM_KEYS), wValue = scancode
+#define VENDOR_RQ_SET_THRESHOLDS	3	//wValue low = press, wValue high = release
+#define VENDOR_RQ_RESET_CONFIG		4	//go back to compiled in defaults
+#define VENDOR_RQ_SET_INPUTS		9	//wValue = enable bits of inputs 0-15, wIndex = inputs 16-17
+
+#define INPUT_ENABLE_DEFAULT	0x3ffffUL	//bit i = input i is scanned, all 18 by default
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						USB SUSPEND SETTINGS						//
+//	Use:															//
+//		host stops keep-alive when it suspends, we must then drop	//
+//		to suspend current and may wake host on a touch. needs		//
+//		USB_COUNT_SOF and D- on INT0, see usbconfig.h				//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#define USB_SUSPEND			USB_COUNT_SOF	// follows usbconfig.h, hardware must be wired for it
+#define SUSPEND_TICKS		(F_CPU/333000UL)	// timer0 ticks (F_CPU/1024) without keep-alive before suspend, ~3ms
+#define SUSPEND_SLOW_SCAN	0		// 0 = power-down, only host or pad on PD3 (INT1) wakes us
+									// 1 = idle sleep and sample all pads every SUSPEND_SCAN_TICKS
+#define SUSPEND_SCAN_TICKS	((F_CPU+10240UL)/20480UL)	// timer1 ticks (F_CPU/1024) between suspend samples, ~50ms
+#define REMOTE_WAKEUP_MS	10		// length of K state for remote wakeup, 1 to 15ms
+#define REMOTE_WAKEUP_WAIT_MS	2	// more idle before K, bus must be idle 5ms (USB 2.0 7.1.7.7), SUSPEND_TICKS gave ~3ms
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						SCHEDULER SETTINGS							//
+//	Use:															//
+//		main loop runs tasks by time. all values are timer1 ticks,	//
+//		F_CPU/8, 1.5 per us at 12MHz, 2.5 at 20MHz. timer1 runs		//
+//		free, wraps after 43ms at 12MHz and 26ms at 20MHz.			//
+//		period is start to start, deadline is how late a start may	//
+//		be, budget is how long a run may take. misses and overruns	//
+//		are counted and can be read with VENDOR_RQ_GET_TASK_STATS.	//
+//		tasks do not preempt, so a deadline must be longer than the	//
+//		budget of every task which may have started just before.	//
+//		period plus deadline must stay below half a timer1 wrap.	//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#define TASK_USB_PERIOD			TICKS_MS(1)	// usbPoll() every 1ms
+#define TASK_USB_DEADLINE		TICKS_MS(2)	// polls < 3ms apart, bus reset takes 10ms
+#define TASK_USB_BUDGET			TICKS_US(300)	// 300us, setup requests included
+
+#define TASK_SCAN_DEADLINE		TICKS_MS(2)	// period comes from keyPressed(), see SCAN_TICKS
+#define TASK_SCAN_BUDGET		TICKS_US(600)	// 600us, waiting for report buffer shows up here
+
+#define TASK_CONFIG_PERIOD		TICKS_MS(1)	// eeprom byte takes 8.5ms, check every 1ms
+#define TASK_CONFIG_DEADLINE	TICKS_MS(10)
+#define TASK_CONFIG_BUDGET		TICKS_US(100)
+
+#define TASK_IDLE_PERIOD		TICKS_MS(4)	// hid idle rate counts 4ms units
+#define TASK_IDLE_DEADLINE		TICKS_MS(4)
+#define TASK_IDLE_BUDGET		TICKS_US(100)
+
+#define TASK_LINK_DEADLINE		TICKS_MS(2)	// period is LINK_PERIOD
+#define TASK_LINK_BUDGET		TICKS_US(800)	// 800us, one frame at 100kHz is ~600us
+
+#define VENDOR_RQ_GET_TASK_STATS	5	//returns struct taskStats for every task
+
 //////////////////////////////////////////////////////////////////////
 
 
@@ -148,14 +477,220 @@ uint8_t button_state = 0;		//these variable is to enable click drag feature
 
 struct measure
 {
+#if FILTER_EMA
+ uint8_t average;		//0 = never touched, 255 = always touched
+#else
  uint8_t measurementBuffer[BUFFER_BYTES];
  uint8_t oldestMeasurement;
  int8_t bufferSum;
+#endif
  uint8_t pressed;
+#if FAST_ATTACK
+ uint8_t run;			//touched samples in a row
+#endif
+#if ADAPTIVE_BASELINE
+ uint16_t baseline;		//idle level of bufferSum, BASELINE_SHIFT fraction bits
+#endif
+#if BRIDGE_DETECT
+ uint8_t age;			//scans since pressed, stops at 255
+ uint8_t bridged;		//pressed only through its neighbour, sends nothing
+#endif
 };
 
 struct measure inputs[TOTAL_KEYS];	//assign structure to each key
 
+//thresholds and baseline work on window scale (0 to BUFFER_BYTES*8) for
+//both filters, exponential average is scaled down to it
+
+#if FILTER_EMA
+#define filterLevel(i)	((int8_t)(((uint16_t)inputs[i].average*(BUFFER_BYTES*8)+128)>>8))
+#else
+#define filterLevel(i)	(inputs[i].bufferSum)
+#endif
+
+#if FILTER_EMA || EXPAND_CHIPS
+//one sample into an exponential average. touched adds 1/8 of the way to 256
+//and stops at 255, idle takes 1/8 rounded up and gets to 0, so level covers
+//the whole window scale like bufferSum does
+static inline uint8_t emaStep(uint8_t average, uint8_t touched)
+{
+ uint16_t next;
+
+ if(!touched)
+  return average-((average+(1<<EMA_SHIFT)-1)>>EMA_SHIFT);
+
+ next=average+(256>>EMA_SHIFT)-(average>>EMA_SHIFT);
+ return next>255 ? 255 : next;
+}
+#endif
+
+#if BRIDGE_DETECT
+#if FILTER_EMA
+#error "BRIDGE_DETECT compares raw samples, it needs the 24 bit window"
+#endif
+#if BRIDGE_ONSET_SCANS>=255
+#error "onset age stops at 255"
+#endif
+uint8_t bridgeCount[TOTAL_KEYS-1];		//[a] is pair a and a+1, stops at 255
+
+//pins next to each other on the same port, a and a+1. PB5/PC0 and
+//PC5/PD1 are on other ports, PD2 between PD1 and PD3 is usb
+#define pinNeighbours(a)	((a)!=5 && (a)!=11 && (a)!=12)
+#endif
+
+//result of selfTest(), goes to host as feature report 3
+
+#define INPUT_OK		0
+#define INPUT_FLOATING	1
+#define INPUT_SHORTED	2
+
+uchar statusReport[1+TOTAL_KEYS] = {3};		//report id, status of every key
+#define inputStatus(i)	(statusReport[1+(i)])
+#define inputLive(i)	(!SELFTEST_MASK || (inputStatus(i)!=INPUT_SHORTED && \
+						 (!SELFTEST_MASK_FLOATING || inputStatus(i)!=INPUT_FLOATING)))
+
+#if CHATTER_GUARD
+//pad on long lead flapping around release level presses many times a
+//second. every window over budget moves its release level one further
+//down, every window without press moves it back one
+struct chatter
+{
+ uint8_t presses[TOTAL_KEYS];	//presses in current window
+ uint8_t widen[TOTAL_KEYS];		//release level is this much below normal
+ uint8_t overBudget[TOTAL_KEYS];	//windows over budget since power-up, stops at 255
+};
+
+struct chatter chatter;
+uint32_t chatterTime=0;			//timer1 ticks into current window
+uint16_t chatterLastTime=0;		//timer1 at last scan
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					STRUCTURE OF TASK SCHEDULER						//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#define TASK_USB		0
+#define TASK_SCAN		1
+#define TASK_CONFIG		2
+#define TASK_IDLE		3
+#if LINK_MODE==LINK_PRIMARY
+#define TASK_LINK		4
+#define TASKS			5
+#else
+#define TASKS			4
+#endif
+
+struct task
+{
+ void (*run)(void);
+ uint16_t period;		//ticks from start to start
+ uint16_t deadline;		//ticks a start may be late before it is missed
+ uint16_t budget;		//ticks a run may take before it is overrun
+ uint16_t lastRun;		//start of last run
+};
+
+struct taskStats
+{
+ uint8_t missed;		//late starts, stops at 255
+ uint8_t overruns;		//runs over budget, stops at 255
+ uint16_t worst;		//longest run in ticks
+};
+
+struct taskStats taskStats[TASKS];
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					STRUCTURE OF ANALOG SENSING						//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#if ADC_SENSE
+struct analog
+{
+ uint8_t value[ADC_PADS];		//last ADCH of each pad, 255 = pulled up, lower = touched
+ uint8_t threshold[ADC_PADS];	//below this pad counts as touched, from boot idle level
+};
+
+struct analog analog;
+volatile uint8_t adcChannel=ADC_PADS;	//channel being converted, ADC_PADS = round done
+volatile uint8_t adcSettle=0;			//conversions of this channel still to throw away
+
+//AVcc reference, left adjusted so ADCH alone is the 8 bit result
+#define ADC_MUX(ch)		((1<<REFS0)|(1<<ADLAR)|(ch))
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					STRUCTURE OF BOARD LINK							//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#if LINK_MODE!=LINK_NONE && ADC_SENSE
+#error "board link needs PC4 and PC5 for TWI, ADC_SENSE uses them as pads"
+#endif
+#if LINK_MODE==LINK_PRIMARY && HID_GAMEPAD
+#error "primary merges secondary boards into keyboard report, not gamepad"
+#endif
+
+//PC4 and PC5 carry TWI, their pads are not scanned
+#define linkPin(i)	(LINK_MODE!=LINK_NONE && ((i)==10 || (i)==11))
+
+#if LINK_MODE==LINK_PRIMARY
+struct linkStats
+{
+ uint16_t frames;		//good frames read
+ uint8_t errors;		//no answer or bad crc, stops at 255
+ uint8_t lostInRow;		//bad or unchanged frames since last good new one
+};
+
+struct linkStats linkStats[LINK_BOARDS];
+uchar linkState[LINK_BOARDS][3];	//pressed bits of every board already in report
+uchar linkSeq[LINK_BOARDS];			//sequence of last frame of every board
+uint8_t linkBoard = 0;				//board read next
+uint8_t linkDirty = 0;				//keyboard report changed, not sent yet
+#endif
+
+#if LINK_MODE==LINK_SECONDARY
+volatile uchar linkFrame[LINK_FRAME];	//newest frame, primary reads it any time
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					STRUCTURE OF INPUT EXPANSION					//
+//																	//
+//	struct measure would take 8 bytes per pad, too much for 64 more	//
+//	pads in 1K RAM. expansion pads get exponential average only,	//
+//	1 byte each, and one pressed bit. thresholds are same as for	//
+//	board pads, no baseline and no fast attack						//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#if EXPAND_CHIPS
+#if EXPAND_CHIPS > 8
+#error "keymap of expansion pads has 64 entries"
+#endif
+#if HID_GAMEPAD || LINK_MODE==LINK_SECONDARY
+#error "expansion pads go into keyboard report"
+#endif
+
+uint8_t expandAverage[EXPAND_PADS];		//0 = never touched, 255 = always touched
+uint8_t expandPressed[EXPAND_CHIPS];	//bit n of byte c = pad c*8+n is pressed
+uint8_t expandDirty = 0;				//keyboard report changed, not sent yet
+#endif
+
+//SPI pins are not scanned as pads
+#define expandPin(i)	(EXPAND_CHIPS && ((i)==2 || (i)==4 || (i)==5))
+
 //////////////////////////////////////////////////////////////////////
 
 static uchar keyPressed();
@@ -181,651 +716,2779 @@ static const uchar  keyReport[NUM_KEYS + 1] PROGMEM = {
 			KEY_K,
 			KEY_L,
 };
-
+
 //////////////////////////////////////////////////////////////////////
 
 
 //////////////////////////////////////////////////////////////////////
 //																	//
-//					 HID REPORT DESCRIPTOR PARSER					//
-//	Use:															//
-//   These are the parser for HID device, each hex numbers in 		//
-//	 array has it's own meaning. Have to go in bit detail to 		//
-//	 explain about this.											//
+//					   RUNTIME CONFIGURATION						//
 //																	//
-//////////////////////////////////////////////////////////////////////
-
-const PROGMEM char usbHidReportDescriptor[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH] 
-= {  //35 /* USB report descriptor */
-    
-	0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
-    0x09, 0x06,                    // USAGE (Keyboard)
-    0xa1, 0x01,                    // COLLECTION (Application)
-	0x85, 0x01,					   //REPORT_ID(1) //edited report id
-    0x05, 0x07,                    //   USAGE_PAGE (Keyboard)
-    0x19, 0xe0,                    //   USAGE_MINIMUM (Keyboard LeftControl)
-    0x29, 0xe7,                    //   USAGE_MAXIMUM (Keyboard Right GUI)
-    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
-    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
-    0x75, 0x01,                    //   REPORT_SIZE (1)
-    0x95, 0x08,                    //   REPORT_COUNT (8)
-    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
-    0x95, 0x06,                    //   REPORT_COUNT (1) //multiple keystrokes
-    0x75, 0x08,                    //   REPORT_SIZE (8)
-    0x25, 0x65,                    //   LOGICAL_MAXIMUM (101)
-    0x19, 0x00,                    //   USAGE_MINIMUM (Reserved (no event indicated))
-    0x29, 0x65,                    //   USAGE_MAXIMUM (Keyboard Application)
-    0x81, 0x00,                    //   INPUT (Data,Ary,Abs)
-    0xc0,                          // END_COLLECTION
+//	keyReport above is only default now, the working copy is in RAM	//
+//	and gets loaded from eeprom on boot.							//
+//																	//
+//////////////////////////////////////////////////////////////////////
 
-	//	Mouse
-    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)	// 54
-    0x09, 0x02,                    // USAGE (Mouse)
-    0xa1, 0x01,                    // COLLECTION (Application)
-    0x09, 0x01,                    //   USAGE (Pointer)
-    0xa1, 0x00,                    //   COLLECTION (Physical)
-    0x85, 0x02,                    //     REPORT_ID (2)
-    0x05, 0x09,                    //     USAGE_PAGE (Button)
-    0x19, 0x01,                    //     USAGE_MINIMUM (Button 1)
-    0x29, 0x03,                    //     USAGE_MAXIMUM (Button 3)
-    0x15, 0x00,                    //     LOGICAL_MINIMUM (0)
-    0x25, 0x01,                    //     LOGICAL_MAXIMUM (1)
-    0x95, 0x03,                    //     REPORT_COUNT (3)
-    0x75, 0x01,                    //     REPORT_SIZE (1)
-    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
-    0x95, 0x01,                    //     REPORT_COUNT (1)
-    0x75, 0x05,                    //     REPORT_SIZE (5)
-    0x81, 0x03,                    //     INPUT (Cnst,Var,Abs)
-    0x05, 0x01,                    //     USAGE_PAGE (Generic Desktop)
-    0x09, 0x30,                    //     USAGE (X)
-    0x09, 0x31,                    //     USAGE (Y)
-    //0x09, 0x38,                    //     USAGE (Wheel)
-    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
-    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
-    0x75, 0x08,                    //     REPORT_SIZE (8)
-    0x95, 0x02,                    //     REPORT_COUNT (2)
-    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
-    0xc0,                          //   END_COLLECTION
-    0xc0,                          // END_COLLECTION
-};
+struct config
+{
+ uint8_t keymap[NUM_KEYS];		//scancode of key 1 to NUM_KEYS
+ int8_t pressThreshold;
+ int8_t releaseThreshold;
+ uint8_t inputEnable[3];		//bit i&7 of byte i>>3 = input i is scanned
+};
 
-/////////////////////////////////////////////////////////////////////////
+struct config config;
+
+#define inputEnabled(i)	((config.inputEnable[(i)>>3]>>((i)&7))&1)
+#define inputActive(i)	(inputLive(i) && inputEnabled(i) && !linkPin(i) && !expandPin(i))
+
+//keyPressed() goes only through these, so scan time follows the number
+//of inputs in use. rebuilt whenever enable mask changes
+uint8_t activeList[TOTAL_KEYS];	//key numbers of active inputs
+uint8_t activeCount = 0;
+uint8_t activeDirty = 1;		//activeList has to be built again
 
+uint8_t configSlot = 0;			//slot holding the newest config
+uint8_t configSeq = 0;			//sequence number of that slot
+uint8_t configDirty = 0;		//RAM copy changed, has to be saved
+uint8_t keymapDirty = 0;		//held key got new scancode, report not sent yet
+
+uint8_t configWriteBuffer[CONFIG_SLOT_SIZE];	//slot image being written
+uint8_t configWriteIndex = 0;	//next byte of configWriteBuffer, 0 = idle
+uint16_t configWriteAddress = 0;
+
+//////////////////////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////////////////////
 //																	//
-//							USB FUNCTIONING							//
-//	Use:															//
-//		This function is used to control the flow of data, request,	//
-//		to the USB.													//
+//						CONFIG CHECKSUM								//
 //																	//
+// Function Name : configChecksum()									//
+// return type : uint8_t											//
+// argument : slot image (sequence + config), length				//
+// 																	//
+// USE:																//
+// 	checksum of a slot, seeded with CONFIG_VERSION so slots written	//
+//	by other firmware layout are never loaded						//
+//  																//
 //////////////////////////////////////////////////////////////////////
-
-uchar	usbFunctionSetup(uchar data[8])
-{
-usbRequest_t    *rq = (void *)data;
 
-uint8_t reportID;
-
-    
-    if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_CLASS){    /* class request type */
-        if(rq->bRequest == USBRQ_HID_GET_REPORT){  /* wValue: ReportType (highbyte), ReportID (lowbyte) */
-            
-			reportID = rq->wValue.bytes[0];
+static uint8_t configChecksum(const uint8_t *data, uint8_t length)
+{
+ uint8_t sum = CONFIG_VERSION;
 
-			if(reportID==1)
-			 {
-            	usbMsgPtr = reportBufferKeyboard;
-				return sizeof(reportBufferKeyboard);
-			 }
-			else if(reportID==2)
-			 {
-			  	usbMsgPtr = reportBufferMouse;
-				return sizeof(reportBufferMouse);
-			 }
-        }else if(rq->bRequest == USBRQ_HID_GET_IDLE){
-            usbMsgPtr = &idleRate;
-            return 1;
-        }else if(rq->bRequest == USBRQ_HID_SET_IDLE){
-            idleRate = rq->wValue.bytes[1];
-        }
-    }else{
-        /* no vendor specific requests implemented */
-    }
-	return 0;
-}
-
-/////////////////////////////////////////////////////////////////////////
+ while(length--)
+  sum = ((sum << 1) | (sum >> 7)) + *data++;
+
+ return sum;
+}
 
+//////////////////////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////////////////////
 //																	//
-//						INITIALIZE HARDWARE							//
+//							REMAP KEY								//
 //																	//
-// Function Name : hardwareInit()									//
+// Function Name : keyRemap()										//
 // return type : void												//
-// argument : void													//
+// argument : key (1 to NUM_KEYS), new scancode						//
 // 																	//
 // USE:																//
-// 	Initialized the hardware unit for usb and for keys.				//
-//	In keys section pull-ups are disabled,external pull-ups used 10M//
+// 	changes scancode of a key. if key is held, its old scancode in	//
+//	keyboard report is swapped for the new one, otherwise			//
+//	releaseKey() would look for the new one and old one stays down	//
 //  																//
 //////////////////////////////////////////////////////////////////////
 
-static void hardwareInit(void)
-{
-uchar	i, j;
-
-    PORTB = 0b11000000;    //de-activate pullups on all pins of PORTB
-    DDRB = 0b11000000;     // all pins are input, MSB 2 pins are not present in uC
-    PORTC = 0b11000000;    // de-activate pullups on all pins of PORTC 
-    DDRC = 0b11000000;     // all pins are input, MSB 2 pins are not present in uC
-    PORTD = 0b00000000;    // de-activate pullups on all pins of PORTD
-    DDRD = 0b00000101;     // all pins input except USB (-> USB reset) 
-	j = 0;
-
-	while(--j){     /* USB Reset by device only required on Watchdog Reset */
-		i = 0;
-		while(--i); /* delay >10ms for USB reset */
-	}
-    
-	DDRD = 0x00;
-
-    /* configure timer 0 for a rate of 12M/(1024 * 256) = 45.78 Hz (~22ms) */
-    TCCR0 = 5;      /* timer 0 prescaler: 1024 */
+static void keyRemap(uint8_t key, uint8_t code)
+{
+ uint8_t i, old=config.keymap[key-1];
+
+ config.keymap[key-1]=code;
+
+ if(!inputs[key-1].pressed || old==0 || old==code)
+  return;
+
+ for(i=2;i<8;i++)
+  if(reportBufferKeyboard[i]==old)
+   {
+    reportBufferKeyboard[i]=code;
+    keymapDirty=1;
+   }
 }
 
-////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////////////////////
 //																	//
-//						PRESS KEYBOARD KEYS							//
+//						CONFIG DEFAULTS								//
 //																	//
-// Function Name : pressKey()										//
+// Function Name : configDefaults()									//
 // return type : void												//
-// argument : key (it's not actually scancode it's array member)	//
+// argument : void													//
 // 																	//
 // USE:																//
-// 	use to press send key press event in computer					//
+// 	fill RAM config with compiled in keymap and thresholds			//
+//	(also used by VENDOR_RQ_RESET_CONFIG, held keys are remapped)	//
 //  																//
 //////////////////////////////////////////////////////////////////////
 
-void pressKey(uint8_t key)
+static void configDefaults(void)
 {
+ uint8_t i;
 
- 	uint8_t i;
+ for(i=0;i<NUM_KEYS;i++)
+  keyRemap(i+1,pgm_read_byte(&keyReport[i+1]));
 
-	reportBufferKeyboard[0]=1; //this is report id
-	reportBufferKeyboard[1]=0; //no modifier
-	
-	//check first if these key is already pressed or not!!!
-	if(reportBufferKeyboard[2]!=pgm_read_byte(&keyReport[key]) &&
-	   reportBufferKeyboard[3]!=pgm_read_byte(&keyReport[key]) &&
-	   reportBufferKeyboard[4]!=pgm_read_byte(&keyReport[key]) && 
-	   reportBufferKeyboard[5]!=pgm_read_byte(&keyReport[key]) &&
-	   reportBufferKeyboard[6]!=pgm_read_byte(&keyReport[key]) &&
-	   reportBufferKeyboard[7]!=pgm_read_byte(&keyReport[key]))
-	   {  
-	    
-		//ok, this key is not pressed, press it now
-		//there are 6 multiple keystrokes
+ config.pressThreshold=PRESS_THRESHOLD;
+ config.releaseThreshold=RELEASE_THRESHOLD;
 
-    	for(i=2;i<8;i++)
-	 	 {
+ config.inputEnable[0]=(uint8_t)INPUT_ENABLE_DEFAULT;
+ config.inputEnable[1]=(uint8_t)(INPUT_ENABLE_DEFAULT>>8);
+ config.inputEnable[2]=(uint8_t)(INPUT_ENABLE_DEFAULT>>16);
+}
 
-		  //check if any buffer is empty
-		  //if it's empty then only put character into buffer
-		  //otherwise :(
+//////////////////////////////////////////////////////////////////////
 
-	      if(reportBufferKeyboard[i]==0)
-		   {
-		    
-			//ok, this buffer is still empty i can add keystroke to this buffer
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						LOAD CONFIG FROM EEPROM						//
+//																	//
+// Function Name : configLoad()										//
+// return type : void												//
+// argument : void													//
+// 																	//
+// USE:																//
+// 	go through all slots and take the valid one with newest 		//
+//	sequence number. if there is none, defaults are used. only		//
+//	called on boot so blocking eeprom reads are fine here			//
+//  																//
+//////////////////////////////////////////////////////////////////////
 
-		    reportBufferKeyboard[i]=pgm_read_byte(&keyReport[key]);
+static void configLoad(void)
+{
+ uint8_t slot, found = 0;
+ uint8_t buffer[CONFIG_SLOT_SIZE];
 
-			//added to buffer i don't need to check for any more buffer
-			//key is already ready to be pressed 
-			//so come out of the loop
+ configDefaults();
 
-			break;
-		   }
-	 	 }
-		 
-		 //shit, no buffer are empty you tried to press more than 6 keys at a time :(
+ for(slot=0;slot<CONFIG_SLOTS;slot++)
+  {
+   eeprom_read_block(buffer,(const void *)(slot*CONFIG_SLOT_SIZE),CONFIG_SLOT_SIZE);
 
-		 if(i==8)
-		  return; //no space to send keystroke
-	   }
+   if(buffer[0]==CONFIG_ERASED_SEQ)
+    continue;
 
+   if(buffer[CONFIG_SLOT_SIZE-1]!=configChecksum(buffer,CONFIG_SLOT_SIZE-1))
+    continue;	//half written or old layout
 
-   //wait until USB device is ready to send another reportBuffer data
-   while(!usbInterruptIsReady()); 
-	
-   //this function actually sends the reportBuffer data
-   usbSetInterrupt(reportBufferKeyboard,sizeof(reportBufferKeyboard));
+   //sequence wraps around, so compare the difference and not the value
+   if(!found || (int8_t)(buffer[0]-configSeq)>0)
+    {
+	 found=1;
+	 configSlot=slot;
+	 configSeq=buffer[0];
+	 for(uint8_t i=0;i<sizeof(struct config);i++)
+	  ((uint8_t *)&config)[i]=buffer[i+1];
+	}
+  }
 
+ if(!found)
+  {
+   //next save goes to slot 0 with sequence 0
+   configSlot=CONFIG_SLOTS-1;
+   configSeq=CONFIG_ERASED_SEQ;
+  }
 }
 
 //////////////////////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////////////////////
 //																	//
-//						RELEASE KEYBOARD KEYS						//
+//						SAVE CONFIG TO EEPROM						//
 //																	//
-// Function Name : releaseKey()										//
+// Function Name : configTask()										//
 // return type : void												//
-// argument : key (it's not actually scancode it's array member)	//
+// argument : void													//
 // 																	//
 // USE:																//
-// 	use to relase key press event in computer						//
+// 	called from main loop, writes at most one eeprom byte per call	//
+//	and only if eeprom is not busy, so one byte write (8.5ms) never	//
+//	blocks usbPoll(). sequence byte is written last, so slot is		//
+//	valid only after the whole slot has been written. also sends	//
+//	keyboard report when keyRemap() changed a held key				//
 //  																//
 //////////////////////////////////////////////////////////////////////
 
-void releaseKey(uint8_t key)
+static void configTask(void)
 {
+ uint8_t i, sreg;
 
- uint8_t i;//,j;
+ if(keymapDirty && usbInterruptIsReady())
+  {
+   usbSetInterrupt(reportBufferKeyboard,sizeof(reportBufferKeyboard));
+   keymapDirty=0;
+  }
 
- 
+ if(EECR & (1<<EEPROM_WRITE))
+  return;	//previous byte is still being written
 
-	 reportBufferKeyboard[0]=1; //this is report id
-	 reportBufferKeyboard[1]=0; //no modifier
-	 
-	//find out if the request key is really pressed or not from our buffer
+ if(configWriteIndex==0)
+  {
+   if(!configDirty)
+    return;
+
+   configDirty=0;
+
+   //take a copy, host may change config again while we are writing
+   configSeq++;
+   if(configSeq==CONFIG_ERASED_SEQ)
+    configSeq=0;
+   configSlot++;
+   if(configSlot>=CONFIG_SLOTS)
+    configSlot=0;
+
+   configWriteBuffer[0]=configSeq;
+   for(i=0;i<sizeof(struct config);i++)
+    configWriteBuffer[i+1]=((uint8_t *)&config)[i];
+   configWriteBuffer[CONFIG_SLOT_SIZE-1]=configChecksum(configWriteBuffer,CONFIG_SLOT_SIZE-1);
+
+   configWriteAddress=configSlot*CONFIG_SLOT_SIZE;
+   configWriteIndex=1;
+  }
 
-	 for(i=2;i<8;i++)
-	  {
-	   
-	    if(reportBufferKeyboard[i]==pgm_read_byte(&keyReport[key]))
-		//yes the key is pressed let's release it now
-	    	reportBufferKeyboard[i]=0;
-	  }
-	
-	//wait until ready
-	while(!usbInterruptIsReady());
-  	
-	//this function actually sends the reportBuffer data
-    usbSetInterrupt(reportBufferKeyboard,sizeof(reportBufferKeyboard));
-  
+ //write bytes 1..end first and sequence byte at the end
+ i = (configWriteIndex<CONFIG_SLOT_SIZE) ? configWriteIndex : 0;
+
+ EEAR=configWriteAddress+i;
+ EEDR=configWriteBuffer[i];
+ sreg=SREG;
+ cli();
+ EECR|=(1<<EEPROM_MASTER_WRITE);	//write must follow within 4 cycles
+ EECR|=(1<<EEPROM_WRITE);
+ SREG=sreg;
+
+ if(i==0)
+  configWriteIndex=0;	//done
+ else
+  configWriteIndex++;
 }
 
 //////////////////////////////////////////////////////////////////////
 
+
 //////////////////////////////////////////////////////////////////////
 //																	//
-//						PRESS MOUSE KEYS							//
+//					 MOUSE ACCELERATION CURVE						//
 //																	//
-// Function Name : pressMouse()										//
-// return type : void												//
-// argument : button (from LSB )									//
-//			  		first bit is left mouse button					//
-//					second bit is right mouse button				//
-//					third bit is middle mouse button				//
+//	1/16 counts per report for every 100ms the cursor keeps moving,	//
+//	last value is kept. driven by time, so scan rate does not		//
+//	change how the cursor feels. starts below one count per report	//
+//	for fine positioning											//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#if !MOUSE_ABSOLUTE && !HID_GAMEPAD
+static const uint16_t mouseCurve[] PROGMEM = {
+			4, 4, 6, 8, 10, 12, 16, 16, 20, 24, 28, 32, 40,
+			48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320,
+};
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					 ABSOLUTE POINTER TARGETS						//
+//																	//
+//	with MOUSE_ABSOLUTE each mouse pad puts the pointer on its own	//
+//	place of the screen. x, y from 0 (left, top) to 32767 (right,	//
+//	bottom), host scales it to the screen it has					//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#if MOUSE_ABSOLUTE
+static const uint16_t absTarget[4][2] PROGMEM = {
+			{16384, 29491},		//pad 12, down arrow: bottom centre
+			{16384,  3277},		//pad 13, up arrow: top centre
+			{ 3277, 16384},		//pad 14, left arrow: left centre
+			{29491, 16384},		//pad 15, right arrow: right centre
+};
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					 KEYS OF SECONDARY BOARDS						//
+//																	//
+//	with LINK_MODE primary, scancode of every pad of every			//
+//	secondary board, [board][pad]. 0 = pad sends nothing. kept in	//
+//	flash like keyReport, RAM holds only 3 pressed bytes, sequence	//
+//	and linkStats per board											//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#if LINK_MODE==LINK_PRIMARY
+static const uchar linkKeymap[LINK_BOARDS][TOTAL_KEYS] PROGMEM = {
+			{0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c,	//a to r
+			 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15},
+			{0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26,	//1 to 0, F1 to F8
+			 0x27, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f, 0x40, 0x41},
+};
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					 KEYS OF EXPANSION PADS							//
+//																	//
+//	with EXPAND_CHIPS, scancode of every pad of the 74HC165 chain,	//
+//	pad A of first chip first. 0 = pad sends nothing				//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#if EXPAND_CHIPS
+static const uchar expandKeymap[64] PROGMEM = {
+			0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b,		//a to z
+			0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13,
+			0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b,
+			0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23,		//1 to 0
+			0x24, 0x25, 0x26, 0x27, 0x3a, 0x3b, 0x3c, 0x3d,		//F1 to F12
+			0x3e, 0x3f, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45,
+			0x59, 0x5a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f, 0x60,		//keypad 1 to 0
+			0x61, 0x62, 0x54, 0x55, 0x56, 0x57, 0x63, 0x58,		//keypad / * - + . enter
+};
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					 HID REPORT DESCRIPTOR PARSER					//
+//	Use:															//
+//   These are the parser for HID device, each hex numbers in 		//
+//	 array has it's own meaning. Have to go in bit detail to 		//
+//	 explain about this.											//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#if HID_GAMEPAD
+//all 18 pads as buttons of one gamepad, 3 byte report without report id
+const PROGMEM char usbHidReportDescriptor[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH]
+= {
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x05,                    // USAGE (Game Pad)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x05, 0x09,                    //   USAGE_PAGE (Button)
+    0x19, 0x01,                    //   USAGE_MINIMUM (Button 1)
+    0x29, TOTAL_KEYS,              //   USAGE_MAXIMUM (Button 18)
+    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01,                    //   REPORT_SIZE (1)
+    0x95, TOTAL_KEYS,              //   REPORT_COUNT (18)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0x75, 24-TOTAL_KEYS,           //   REPORT_SIZE (6)
+    0x95, 0x01,                    //   REPORT_COUNT (1)
+    0x81, 0x03,                    //   INPUT (Cnst,Var,Abs)
+    0xc0,                          // END_COLLECTION
+
+	//	Input status, feature report
+    0x06, 0x00, 0xff,              // USAGE_PAGE (Vendor Defined Page 1)
+    0x09, 0x01,                    // USAGE (Vendor Usage 1)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x09, 0x02,                    //   USAGE (Vendor Usage 2)
+    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
+    0x25, 0x02,                    //   LOGICAL_MAXIMUM (2)
+    0x75, 0x08,                    //   REPORT_SIZE (8)
+    0x95, TOTAL_KEYS,              //   REPORT_COUNT (18)
+    0xb1, 0x02,                    //   FEATURE (Data,Var,Abs)
+    0xc0                           // END_COLLECTION
+};
+#else
+const PROGMEM char usbHidReportDescriptor[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH] 
+= {  //35 /* USB report descriptor */
+    
+	0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)
+    0x09, 0x06,                    // USAGE (Keyboard)
+    0xa1, 0x01,                    // COLLECTION (Application)
+	0x85, 0x01,					   //REPORT_ID(1) //edited report id
+    0x05, 0x07,                    //   USAGE_PAGE (Keyboard)
+    0x19, 0xe0,                    //   USAGE_MINIMUM (Keyboard LeftControl)
+    0x29, 0xe7,                    //   USAGE_MAXIMUM (Keyboard Right GUI)
+    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //   LOGICAL_MAXIMUM (1)
+    0x75, 0x01,                    //   REPORT_SIZE (1)
+    0x95, 0x08,                    //   REPORT_COUNT (8)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0x95, 0x06,                    //   REPORT_COUNT (1) //multiple keystrokes
+    0x75, 0x08,                    //   REPORT_SIZE (8)
+    0x25, 0x65,                    //   LOGICAL_MAXIMUM (101)
+    0x19, 0x00,                    //   USAGE_MINIMUM (Reserved (no event indicated))
+    0x29, 0x65,                    //   USAGE_MAXIMUM (Keyboard Application)
+    0x81, 0x00,                    //   INPUT (Data,Ary,Abs)
+    0xc0,                          // END_COLLECTION
+
+	//	Mouse
+    0x05, 0x01,                    // USAGE_PAGE (Generic Desktop)	// 54
+    0x09, 0x02,                    // USAGE (Mouse)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x09, 0x01,                    //   USAGE (Pointer)
+    0xa1, 0x00,                    //   COLLECTION (Physical)
+    0x85, 0x02,                    //     REPORT_ID (2)
+    0x05, 0x09,                    //     USAGE_PAGE (Button)
+    0x19, 0x01,                    //     USAGE_MINIMUM (Button 1)
+    0x29, 0x03,                    //     USAGE_MAXIMUM (Button 3)
+    0x15, 0x00,                    //     LOGICAL_MINIMUM (0)
+    0x25, 0x01,                    //     LOGICAL_MAXIMUM (1)
+    0x95, 0x03,                    //     REPORT_COUNT (3)
+    0x75, 0x01,                    //     REPORT_SIZE (1)
+    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
+    0x95, 0x01,                    //     REPORT_COUNT (1)
+    0x75, 0x05,                    //     REPORT_SIZE (5)
+    0x81, 0x03,                    //     INPUT (Cnst,Var,Abs)
+    0x05, 0x01,                    //     USAGE_PAGE (Generic Desktop)
+    0x09, 0x30,                    //     USAGE (X)
+    0x09, 0x31,                    //     USAGE (Y)
+#if MOUSE_ABSOLUTE
+    0x16, 0x00, 0x00,              //     LOGICAL_MINIMUM (0)		//same length as relative part
+    0x26, 0xff, 0x7f,              //     LOGICAL_MAXIMUM (32767)
+    0x75, 0x10,                    //     REPORT_SIZE (16)
+    0x95, 0x02,                    //     REPORT_COUNT (2)
+    0x81, 0x02,                    //     INPUT (Data,Var,Abs)
+#else
+    0x09, 0x38,                    //     USAGE (Wheel)
+    0x15, 0x81,                    //     LOGICAL_MINIMUM (-127)
+    0x25, 0x7f,                    //     LOGICAL_MAXIMUM (127)
+    0x75, 0x08,                    //     REPORT_SIZE (8)
+    0x95, 0x03,                    //     REPORT_COUNT (3)
+    0x81, 0x06,                    //     INPUT (Data,Var,Rel)
+#endif
+    0xc0,                          //   END_COLLECTION
+    0xc0,                          // END_COLLECTION
+
+	//	Input status, feature report
+    0x06, 0x00, 0xff,              // USAGE_PAGE (Vendor Defined Page 1)
+    0x09, 0x01,                    // USAGE (Vendor Usage 1)
+    0xa1, 0x01,                    // COLLECTION (Application)
+    0x85, 0x03,                    //   REPORT_ID (3)
+    0x09, 0x02,                    //   USAGE (Vendor Usage 2)
+    0x15, 0x00,                    //   LOGICAL_MINIMUM (0)
+    0x25, 0x02,                    //   LOGICAL_MAXIMUM (2)
+    0x75, 0x08,                    //   REPORT_SIZE (8)
+    0x95, TOTAL_KEYS,              //   REPORT_COUNT (18)
+    0xb1, 0x02,                    //   FEATURE (Data,Var,Abs)
+    0xc0                           // END_COLLECTION
+};
+#endif
+
+/////////////////////////////////////////////////////////////////////////
+
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//					 USB CONFIGURATION DESCRIPTOR					//
+//	Use:															//
+//		same as the one in usbdrv.c, only attributes tell the host	//
+//		we can do remote wakeup. usbconfig.h switches to this one	//
+//		together with USB_COUNT_SOF									//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+#if USB_SUSPEND
+const PROGMEM char usbDescriptorConfiguration[34] = {
+    9,                             // sizeof(usbDescriptorConfiguration)
+    USBDESCR_CONFIG,               // descriptor type
+    34, 0,                         // total length including inlined descriptors
+    1,                             // number of interfaces
+    1,                             // index of this configuration
+    0,                             // configuration name string index
+    (1 << 7) | USBATTR_REMOTEWAKE, // attributes: bus powered, remote wakeup
+    USB_CFG_MAX_BUS_POWER/2,       // max current in 2mA units
+
+    9,                             // sizeof(usbDescrInterface)
+    USBDESCR_INTERFACE,            // descriptor type
+    0,                             // index of this interface
+    0,                             // alternate setting
+    1,                             // endpoints excl 0
+    USB_CFG_INTERFACE_CLASS,
+    USB_CFG_INTERFACE_SUBCLASS,
+    USB_CFG_INTERFACE_PROTOCOL,
+    0,                             // string index for interface
+
+    9,                             // sizeof(usbDescrHID)
+    USBDESCR_HID,                  // descriptor type: HID
+    0x01, 0x01,                    // HID version 1.01
+    0x00,                          // target country code
+    0x01,                          // number of report descriptors
+    0x22,                          // descriptor type: report
+    USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH, 0,
+
+    7,                             // sizeof(usbDescrEndpoint)
+    USBDESCR_ENDPOINT,             // descriptor type
+    (char)0x81,                    // IN endpoint number 1
+    0x03,                          // interrupt endpoint
+    8, 0,                          // maximum packet size
+    USB_CFG_INTR_POLL_INTERVAL,    // in ms
+};
+#endif
+
+/////////////////////////////////////////////////////////////////////////
+
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							USB FUNCTIONING							//
+//	Use:															//
+//		This function is used to control the flow of data, request,	//
+//		to the USB.													//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+uchar	usbFunctionSetup(uchar data[8])
+{
+usbRequest_t    *rq = (void *)data;
+
+uint8_t reportID;
+
+    
+    if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_CLASS){    /* class request type */
+        if(rq->bRequest == USBRQ_HID_GET_REPORT){  /* wValue: ReportType (highbyte), ReportID (lowbyte) */
+            
+			reportID = rq->wValue.bytes[0];
+
+#if HID_GAMEPAD
+			if(rq->wValue.bytes[1] == 3)		//feature, no id either
+			 {
+			  usbMsgPtr = statusReport + 1;
+			  return TOTAL_KEYS;
+			 }
+			usbMsgPtr = reportBufferGamepad;	//only input report, no id
+			return sizeof(reportBufferGamepad);
+#endif
+			if(reportID==1)
+			 {
+            	usbMsgPtr = reportBufferKeyboard;
+				return sizeof(reportBufferKeyboard);
+			 }
+			else if(reportID==2)
+			 {
+			  	usbMsgPtr = reportBufferMouse;
+				return sizeof(reportBufferMouse);
+			 }
+			else if(reportID==3)
+			 {
+			  	usbMsgPtr = statusReport;		//feature report, self test result
+				return sizeof(statusReport);
+			 }
+        }else if(rq->bRequest == USBRQ_HID_GET_IDLE){
+            usbMsgPtr = &idleRate;
+            return 1;
+        }else if(rq->bRequest == USBRQ_HID_SET_IDLE){
+            idleRate = rq->wValue.bytes[1];
+        }
+    }else if((rq->bmRequestType & USBRQ_TYPE_MASK) == USBRQ_TYPE_VENDOR){
+        if(rq->bRequest == VENDOR_RQ_GET_CONFIG){
+            usbMsgPtr = (uchar *)&config;
+            return sizeof(config);
+        }else if(rq->bRequest == VENDOR_RQ_SET_KEY){
+            //key number is same as in keyReport, 1 to NUM_KEYS
+            if(rq->wIndex.bytes[0] >= 1 && rq->wIndex.bytes[0] <= NUM_KEYS){
+                keyRemap(rq->wIndex.bytes[0], rq->wValue.bytes[0]);
+                configDirty = 1;
+            }
+        }else if(rq->bRequest == VENDOR_RQ_SET_THRESHOLDS){
+            //keep hysteresis, release must be below press and press inside the window.
+            //release 0 would never let go, level can not drop below 0
+            if(rq->wValue.bytes[1] >= 1 &&
+               rq->wValue.bytes[1] < rq->wValue.bytes[0] &&
+               rq->wValue.bytes[0] < BUFFER_BYTES * 8){
+                config.pressThreshold = rq->wValue.bytes[0];
+                config.releaseThreshold = rq->wValue.bytes[1];
+                configDirty = 1;
+            }
+        }else if(rq->bRequest == VENDOR_RQ_SET_INPUTS){
+            config.inputEnable[0] = rq->wValue.bytes[0];
+            config.inputEnable[1] = rq->wValue.bytes[1];
+            config.inputEnable[2] = rq->wIndex.bytes[0] & 0x03;
+            configDirty = 1;
+            activeDirty = 1;
+        }else if(rq->bRequest == VENDOR_RQ_RESET_CONFIG){
+            configDefaults();
+            configDirty = 1;
+            activeDirty = 1;
+        }else if(rq->bRequest == VENDOR_RQ_GET_TASK_STATS){
+            usbMsgPtr = (uchar *)taskStats;
+            return sizeof(taskStats);
+#if LINK_MODE==LINK_PRIMARY
+        }else if(rq->bRequest == VENDOR_RQ_GET_LINK){
+            usbMsgPtr = (uchar *)linkStats;
+            return sizeof(linkStats);
+#endif
+#if CHATTER_GUARD
+        }else if(rq->bRequest == VENDOR_RQ_GET_CHATTER){
+            usbMsgPtr = (uchar *)&chatter;
+            return sizeof(chatter);
+#endif
+#if BRIDGE_DETECT
+        }else if(rq->bRequest == VENDOR_RQ_GET_BRIDGES){
+            usbMsgPtr = bridgeCount;
+            return sizeof(bridgeCount);
+#endif
+#if ADC_SENSE
+        }else if(rq->bRequest == VENDOR_RQ_GET_ANALOG){
+            usbMsgPtr = (uchar *)&analog;
+            return sizeof(analog);
+#endif
+        }
+    }
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////
+
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							READ INPUT								//
+//																	//
+// Function Name : pinLow()											//
+// return type : uint8_t											//
+// argument : key number (0 to TOTAL_KEYS-1)						//
+// 																	//
+// Function Name : readInput()										//
+// return type : uint8_t											//
+// argument : key number (0 to TOTAL_KEYS-1)						//
+// 																	//
+// USE:																//
+// 	pinLow() returns 1 if pin of the key reads low. readInput()		//
+//	returns 1 if input is touched. pins are pulled up by 10M, so	//
+//	touched pin reads low, or ADC reads below threshold				//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+static inline uint8_t pinLow(uint8_t i)
+{
+ uint8_t newMeasurement=0;
+
+ if(i<6)
+  newMeasurement=(PINB&(1<<i));		//pin0 to 5 portb
+ else if(i>=6 && i<12)
+  newMeasurement=(PINC&(1<<(i-6)));   //this is pc0-5
+ else if(i==12)
+  newMeasurement=(PIND&(1<<1));       //this is pd1
+ else if(i>12 && i<18)
+  newMeasurement=(PIND&(1<<(i-10)));  //start from pd3 to pd7
+
+ return !newMeasurement;
+}
+
+static inline uint8_t readInput(uint8_t i)
+{
+#if ADC_SENSE
+ if(i>=6 && i<12)
+  return analog.value[i-6]<analog.threshold[i-6];	//touch pulls adc0-5 below idle level
+#endif
+
+ return pinLow(i);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							SELF TEST								//
+//																	//
+// Function Name : selfTest()										//
+// return type : void												//
+// argument : void													//
+// 																	//
+// USE:																//
+// 	runs once at power-up, sets inputStatus of every key.			//
+//	internal pull-up (~50k) wins against any touch, so pin still	//
+//	low with it is shorted to ground. then pins are driven low and	//
+//	let go, 10M charges the lead back up in few ms. pin still low	//
+//	has no pull-up and floats. a pad touched at power-up looks		//
+//	floating too, so floating is only reported and stays scanned	//
+//	unless SELFTEST_MASK_FLOATING. seedFilter() then starts it		//
+//	pressed and it releases when let go								//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#define SELFTEST_PC	(LINK_MODE!=LINK_NONE ? 0x0f : 0x3f)	//TWI lines are not touched
+#define SELFTEST_PB	(EXPAND_CHIPS ? 0x0b : 0x3f)			//nor SPI lines
+
+static void selfTest(void)
+{
+ uint8_t i;
+
+ //usb lines PD0 and PD2 are left alone
+ PORTB|=SELFTEST_PB;
+ PORTC|=SELFTEST_PC;
+ PORTD|=0xfa;
+ _delay_us(SELFTEST_PULLUP_US);
+
+ for(i=0;i<TOTAL_KEYS;i++)
+  inputStatus(i)=pinLow(i) ? INPUT_SHORTED : INPUT_OK;
+
+ PORTB&=~SELFTEST_PB;
+ PORTC&=~SELFTEST_PC;
+ PORTD&=~0xfa;
+
+ DDRB|=SELFTEST_PB;
+ DDRC|=SELFTEST_PC;
+ DDRD|=0xfa;
+ _delay_us(SELFTEST_PULLUP_US);
+ DDRB&=~SELFTEST_PB;
+ DDRC&=~SELFTEST_PC;
+ DDRD&=~0xfa;
+ _delay_ms(SELFTEST_RISE_MS);
+
+ for(i=0;i<TOTAL_KEYS;i++)
+  if(inputStatus(i)==INPUT_OK && pinLow(i))
+   inputStatus(i)=INPUT_FLOATING;
+}
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						SEED FILTER OF A KEY						//
+//																	//
+// Function Name : seedFilter()										//
+// return type : void												//
+// argument : key number, level (0 to BUFFER_BYTES*8)				//
+// 																	//
+// USE:																//
+// 	fill measurement buffer of a key with 'level' ones, so filter	//
+//	starts settled on that level instead of settling in 24 scans.	//
+//	key already above press threshold is marked pressed without		//
+//	sending it, so a pad touched on power-up is not stuck down		//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+static void seedFilter(uint8_t i, uint8_t level)
+{
+#if FILTER_EMA
+ inputs[i].average=((uint16_t)level*255)/(BUFFER_BYTES*8);
+#else
+ uint8_t j, bits = level;
+
+ //bufferSum must always be number of ones in the buffer
+ for(j=0;j<BUFFER_BYTES;j++)
+  {
+   if(bits>=8)
+    {
+	 inputs[i].measurementBuffer[j]=0xff;
+	 bits-=8;
+	}
+   else
+    {
+	 inputs[i].measurementBuffer[j]=(1<<bits)-1;
+	 bits=0;
+	}
+  }
+
+ inputs[i].bufferSum=level;
+#endif
+#if ADAPTIVE_BASELINE
+ //touched level is no idle level, baseline would hold pressLevel up after release
+ inputs[i].baseline = level<=config.pressThreshold ? (uint16_t)level<<BASELINE_SHIFT : 0;
+#endif
+ inputs[i].pressed=(level>config.pressThreshold);
+}
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						BUILD ACTIVE LIST							//
+//																	//
+// Function Name : activeBuild()									//
+// return type : void												//
+// argument : void													//
+// 																	//
+// USE:																//
+// 	puts every enabled input which passed self test into			//
+//	activeList. disabled input still pressed stays in until it is	//
+//	released, so its key is not stuck down, and list is built		//
+//	again on next scan. other disabled inputs get empty filter, so	//
+//	they start clean when enabled again								//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+static void activeBuild(void)
+{
+ uint8_t i;
+
+ activeCount=0;
+ activeDirty=0;
+
+ for(i=0;i<TOTAL_KEYS;i++)
+  {
+   if(inputActive(i))
+    activeList[activeCount++]=i;
+   else if(inputs[i].pressed && inputLive(i))
+    {
+     activeList[activeCount++]=i;
+     activeDirty=1;
+    }
+   else
+    seedFilter(i,0);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						RAISE FILTER OF A KEY						//
+//																	//
+// Function Name : raiseFilter()									//
+// return type : void												//
+// argument : key number, level (0 to BUFFER_BYTES*8)				//
+// 																	//
+// USE:																//
+// 	bring filter of a key up to at least 'level' without throwing	//
+//	away the samples it already has, used by fast attack press		//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if FAST_ATTACK
+static void raiseFilter(uint8_t i, uint8_t level)
+{
+#if FILTER_EMA
+ uint8_t average=((uint16_t)level*255+(BUFFER_BYTES*8-1))/(BUFFER_BYTES*8);
+
+ if(inputs[i].average<average)
+  inputs[i].average=average;
+#else
+ uint8_t j;
+
+ //set lowest zero bits until enough ones are in the window
+ for(j=0;j<BUFFER_BYTES;j++)
+  while(inputs[i].measurementBuffer[j]!=0xff && inputs[i].bufferSum<(int8_t)level)
+   {
+    inputs[i].measurementBuffer[j]|=inputs[i].measurementBuffer[j]+1;
+	inputs[i].bufferSum++;
+   }
+#endif
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						INITIALIZE HARDWARE							//
+//																	//
+// Function Name : hardwareInit()									//
+// return type : void												//
+// argument : void													//
+// 																	//
+// USE:																//
+// 	Initialized the hardware unit for usb and for keys.				//
+//	In keys section pull-ups are disabled,external pull-ups used 10M//
+//	usb reset delay is also used to measure idle level of all keys	//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+static void hardwareInit(void)
+{
+uchar	i, j;
+#if CALIBRATE_ON_BOOT
+uchar	k, idleCount[TOTAL_KEYS];
+
+	for(k=0;k<TOTAL_KEYS;k++)
+	 idleCount[k]=0;
+#endif
+#if ADC_SENSE
+uchar	c, d, adcIdle[ADC_PADS];
+uint16_t	adcSum[ADC_PADS];
+
+	for(c=0;c<ADC_PADS;c++)
+	 {
+	  adcSum[c]=0;
+	  adcIdle[c]=0;
+	  analog.threshold[c]=0xff-ADC_TOUCH_DROP;	//until idle level is known, readInput() needs one
+	 }
+
+	//F_CPU/64 = 187kHz at 12MHz, 312kHz at 20MHz, 8 bit result is still good
+	ADCSRA = (1<<ADEN)|(1<<ADPS2)|(1<<ADPS1);
+#endif
+
+    PORTB = 0b11000000;    //de-activate pullups on all pins of PORTB
+    DDRB = 0b11000000;     // all pins are input, MSB 2 pins are not present in uC
+    PORTC = 0b11000000;    // de-activate pullups on all pins of PORTC 
+    DDRC = 0b11000000;     // all pins are input, MSB 2 pins are not present in uC
+    PORTD = 0b00000000;    // de-activate pullups on all pins of PORTD
+    DDRD = 0b00000101;     // all pins input except USB (-> USB reset) 
+
+	selfTest();
+
+	j = 0;
+
+	while(--j){     /* USB Reset by device only required on Watchdog Reset */
+#if ADC_SENSE
+		for(c=0;c<ADC_PADS;c++)		//interrupts are still off, wait for each conversion
+		 {
+		  ADMUX = ADC_MUX(c);
+		  for(d=0;d<=ADC_DISCARD;d++)	//only last one settled
+		   {
+		    ADCSRA |= (1<<ADSC);
+		    while(ADCSRA & (1<<ADSC));
+		   }
+		  analog.value[c] = ADCH;	//readInput() below sees it too
+		  if(analog.value[c] >= analog.threshold[c])	//touched samples are no idle level
+		   {
+		    adcSum[c] += analog.value[c];
+		    adcIdle[c]++;
+		   }
+		 }
+#endif
+#if CALIBRATE_ON_BOOT
+		for(k=0;k<TOTAL_KEYS;k++)	//255 samples over ~20ms, one full mains period
+		 idleCount[k]+=inputActive(k) && readInput(k);
+#endif
+		i = 0;
+		while(--i); /* delay >10ms for USB reset */
+	}
+    
+	DDRD = 0x00;
+
+#if ADC_SENSE
+	for(c=0;c<ADC_PADS;c++)		//average of untouched samples is idle level of pad
+	 if(adcIdle[c])				//touched all along keeps threshold below full scale
+	  {
+	   j = adcSum[c]/adcIdle[c];
+	   analog.threshold[c] = j>ADC_TOUCH_DROP ? j-ADC_TOUCH_DROP : 0;
+	  }
+	ADCSRA |= (1<<ADIE);		//from now on conversions run in ADC_vect
+#endif
+
+#if CALIBRATE_ON_BOOT
+	for(k=0;k<TOTAL_KEYS;k++)	//scale 255 samples down to the filter window
+	 seedFilter(k,((uint16_t)idleCount[k]*(BUFFER_BYTES*8)+127)/255);
+#endif
+
+    /* configure timer 0 for a rate of F_CPU/(1024 * 256), 45.78 Hz (~22ms) at 12MHz */
+    TIMER0_CONTROL = 5;      /* timer 0 prescaler: 1024 */
+
+#if LINK_MODE==LINK_PRIMARY
+	TWBR = LINK_TWBR;		//master, driven by linkTask
+	TWSR = 0;
+	TWCR = (1<<TWEN);
+#elif LINK_MODE==LINK_SECONDARY
+	TWAR = (LINK_ADDRESS+LINK_SELF)<<1;		//slave, answered in TWI_vect
+	TWCR = (1<<TWEA)|(1<<TWEN)|(1<<TWIE);
+#endif
+
+#if EXPAND_CHIPS
+	PORTB |= (1<<PB2);					//74HC165 shifting, load is a low pulse
+	DDRB |= (1<<PB2)|(1<<PB5);			//PB4 (MISO) stays input, PB3 stays a pad
+	SPCR = EXPAND_SPI;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						PRESS KEYBOARD KEYS							//
+//																	//
+// Function Name : pressKey()										//
+// return type : void												//
+// argument : key (it's not actually scancode it's array member)	//
+// 																	//
+// USE:																//
+// 	use to press send key press event in computer					//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+void pressKey(uint8_t key)
+{
+
+ 	uint8_t i;
+
+	reportBufferKeyboard[0]=1; //this is report id
+	reportBufferKeyboard[1]=0; //no modifier
+	
+	//check first if these key is already pressed or not!!!
+	if(reportBufferKeyboard[2]!=config.keymap[key-1] &&
+	   reportBufferKeyboard[3]!=config.keymap[key-1] &&
+	   reportBufferKeyboard[4]!=config.keymap[key-1] && 
+	   reportBufferKeyboard[5]!=config.keymap[key-1] &&
+	   reportBufferKeyboard[6]!=config.keymap[key-1] &&
+	   reportBufferKeyboard[7]!=config.keymap[key-1])
+	   {  
+	    
+		//ok, this key is not pressed, press it now
+		//there are 6 multiple keystrokes
+
+    	for(i=2;i<8;i++)
+	 	 {
+
+		  //check if any buffer is empty
+		  //if it's empty then only put character into buffer
+		  //otherwise :(
+
+	      if(reportBufferKeyboard[i]==0)
+		   {
+		    
+			//ok, this buffer is still empty i can add keystroke to this buffer
+
+		    reportBufferKeyboard[i]=config.keymap[key-1];
+
+			//added to buffer i don't need to check for any more buffer
+			//key is already ready to be pressed 
+			//so come out of the loop
+
+			break;
+		   }
+	 	 }
+		 
+		 //shit, no buffer are empty you tried to press more than 6 keys at a time :(
+
+		 if(i==8)
+		  return; //no space to send keystroke
+	   }
+
+
+   //wait until USB device is ready to send another reportBuffer data
+   while(!usbInterruptIsReady()); 
+	
+   //this function actually sends the reportBuffer data
+   usbSetInterrupt(reportBufferKeyboard,sizeof(reportBufferKeyboard));
+
+}
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						RELEASE KEYBOARD KEYS						//
+//																	//
+// Function Name : releaseKey()										//
+// return type : void												//
+// argument : key (it's not actually scancode it's array member)	//
+// 																	//
+// USE:																//
+// 	use to relase key press event in computer						//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+void releaseKey(uint8_t key)
+{
+
+ uint8_t i;//,j;
+
+ 
+
+	 reportBufferKeyboard[0]=1; //this is report id
+	 reportBufferKeyboard[1]=0; //no modifier
+	 
+	//find out if the request key is really pressed or not from our buffer
+
+	 for(i=2;i<8;i++)
+	  {
+	   
+	    if(reportBufferKeyboard[i]==config.keymap[key-1])
+		//yes the key is pressed let's release it now
+	    	reportBufferKeyboard[i]=0;
+	  }
+	
+	//wait until ready
+	while(!usbInterruptIsReady());
+  	
+	//this function actually sends the reportBuffer data
+    usbSetInterrupt(reportBufferKeyboard,sizeof(reportBufferKeyboard));
+  
+}
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						KEYBOARD SCANCODE							//
+//																	//
+// Function Name : keyboardCode()									//
+// return type : void												//
+// argument : scancode, 1 = down or 0 = up							//
+// 																	//
+// USE:																//
+// 	puts scancode into keyboard report or takes it out, nothing is	//
+//	sent. for callers which must not wait for the endpoint, they	//
+//	send report themselves when it is free. 6 keys full drops it	//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if TURBO_KEYS || LINK_MODE==LINK_PRIMARY || EXPAND_CHIPS
+static void keyboardCode(uint8_t code, uint8_t down)
+{
+ uint8_t j,empty=0;
+
+ reportBufferKeyboard[0]=1; //this is report id
+ reportBufferKeyboard[1]=0; //no modifier
+
+ for(j=2;j<8;j++)
+  {
+   if(reportBufferKeyboard[j]==code)
+    break;
+   if(!empty && !reportBufferKeyboard[j])
+    empty=j;
+  }
+
+ if(down)
+  {
+   if(j==8 && empty)		//not in report yet
+    reportBufferKeyboard[empty]=code;
+  }
+ else if(j<8)
+  reportBufferKeyboard[j]=0;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						PRESS MOUSE KEYS							//
+//																	//
+// Function Name : pressMouse()										//
+// return type : void												//
+// argument : button (from LSB )									//
+//			  		first bit is left mouse button					//
+//					second bit is right mouse button				//
+//					third bit is middle mouse button				//
+// 																	//
+// USE:																//
+// 	use to press mouse button event in computer						//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+void pressMouse(uint8_t button)
+{
+
+   reportBufferMouse[0]=2; //this is report id
+
+   if(button==0)
+    button_state=0b00000000;   	  //this is buttons
+   else if(button==1) 			  //left button click
+    button_state=0b00000001;	  
+   else if(button==2)			  //right button click
+    button_state=0b00000010;
+   else if(button==3)			  //middle button click
+    button_state=0b00000100;
+   
+   reportBufferMouse[1]=button_state;   //button state, to enable click drag feature
+#if !MOUSE_ABSOLUTE						//absolute pointer stays where it is
+   reportBufferMouse[2]=0; 				//do not move on x axis
+   reportBufferMouse[3]=0; 				//do not move on y axis
+
+   //while(!usbInterruptIsReady()); //wait until interrupt is ready
+   
+   reportBufferMouse[4]=mouseWheel;		//pending scroll goes with this report
+#endif
+
+   //wait until interrupt is ready
+   if(usbInterruptIsReady())
+    {
+     //this function actually sends the reportBuffer data
+   	 usbSetInterrupt(reportBufferMouse,sizeof(reportBufferMouse));
+	 mouseWheel=0;
+	}
+ 
+}
+
+////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						RELEASE MOUSE KEYS							//
+//																	//
+// Function Name : releaseKey()										//
+// return type : void												//
+// argument : key (same as pressMouse function description)			//
+// 																	//
+// USE:																//
+// 	use to relase mouse key press event in computer					//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+void releaseMouse(uint8_t key)
+{
+   //reset appropriate bit from 3 bits
+   button_state&=~key;   
+
+   reportBufferMouse[0]=2; //this is report id
+
+   reportBufferMouse[1]=button_state;   //this is buttons
+
+#if !MOUSE_ABSOLUTE
+   reportBufferMouse[2]=0; //do not move on x axis
+   reportBufferMouse[3]=0; //do not move on y axis
+
+   //while(!usbInterruptIsReady()); //wait until interrupt is ready
+   
+   reportBufferMouse[4]=mouseWheel;		//pending scroll goes with this report
+#endif
+
+   //wait until interrupt is ready
+   if(usbInterruptIsReady())
+    {
+     //this function actually sends the reportBuffer data
+   	 usbSetInterrupt(reportBufferMouse,sizeof(reportBufferMouse));
+	 mouseWheel=0;
+	}
+
+}
+
+/////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//								MOVE MOUSE 							//
+//																	//
+// Function Name : moveMouse()										//
+// return type : void												//
+// argument : x +ve values moves to +ve x axis and vice-versa		//
+//			  y +ve values moves to +ve y axis and vice-versa		//
+// 																	//
+// USE:																//
+// 	use to relase mouse key press event in computer					//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+void moveMouse(int8_t x, int8_t y)
+{
+
+     reportBufferMouse[0]=2;  //report id of mouse, see report descriptor for this id
+	 reportBufferMouse[1]=button_state; // to keep last state of mouse button alive
+	 reportBufferMouse[2]=x;	//move mouse cursor in x-axis
+	 reportBufferMouse[3]=y;	//move mouse cursor in y-axis
+	 reportBufferMouse[4]=mouseWheel;	//pending scroll goes with this report
+	 
+	 //if(x==0 && y==0)
+	  //reportBufferMouse[1]=0;
+	 //while(!usbInterruptIsReady()); //wait until interrupt is ready
+
+	//wait until interrupt is ready
+	if(usbInterruptIsReady())
+	 {
+	  //this function actually sends the reportBuffer data
+	  usbSetInterrupt(reportBufferMouse,sizeof(reportBufferMouse));
+	  mouseWheel=0;
+	 }
+
+}
+
+/////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							POINT TO 								//
+//																	//
+// Function Name : pointTo()										//
+// return type : uint8_t, 1 if report went out						//
+// argument : mouse pad, 0 to 3 for pads 12 to 15					//
+// 																	//
+// USE:																//
+// 	puts absolute pointer on absTarget of the pad with one report,	//
+//	buttons stay as they are. x and y go little endian, 0 to 32767	//
+//	covers the whole screen											//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if MOUSE_ABSOLUTE
+static uint8_t pointTo(uint8_t pad)
+{
+ uint16_t x,y;
+
+ if(!usbInterruptIsReady())
+  return 0;
+
+ x=pgm_read_word(&absTarget[pad][0]);
+ y=pgm_read_word(&absTarget[pad][1]);
+
+ reportBufferMouse[0]=2;
+ reportBufferMouse[1]=button_state;
+ reportBufferMouse[2]=x;
+ reportBufferMouse[3]=x>>8;
+ reportBufferMouse[4]=y;
+ reportBufferMouse[5]=y>>8;
+
+ usbSetInterrupt(reportBufferMouse,sizeof(reportBufferMouse));
+ return 1;
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//								SWIPE 								//
+//																	//
+// Function Name : swipePad()										//
+// return type : void												//
+// argument : pad of the strip which was just pressed (0 to			//
+//			  SWIPE_PADS-1)											//
+// 																	//
+// USE:																//
+// 	touching the pad next to the last one within SWIPE_TIMEOUT		//
+//	is one step of a swipe and scrolls one notch, towards higher	//
+//	pads scrolls down. constant time, called only on a press		//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if SWIPE_SCROLL
+static void swipePad(uint8_t pad)
+{
+ int8_t step=pad-swipeLast;
+
+ if(swipeTime<SWIPE_TIMEOUT && (step==1 || step==-1))
+  {
+   if((step>0 && mouseWheel>-127) || (step<0 && mouseWheel<127))
+    mouseWheel-=step;
+  }
+
+ swipeLast=pad;
+ swipeTime=0;
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							INTENSITY 								//
+//																	//
+// Function Name : intensitySpeed()									//
+// return type : int16_t											//
+// argument : index of the pressed mouse pad, its release level	//
+// 																	//
+// USE:																//
+// 	firm contact fills the whole filter window, light or partial	//
+//	contact stays just above the threshold. returns mouseSpeed		//
+//	scaled by how far the pad is above the release level			//
+//	keyPressed() used for it in this scan, full						//
+//	window gives full speed. uses the filter level only, no			//
+//	second sensing path												//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if MOUSE_INTENSITY
+static int16_t intensitySpeed(uint8_t i, int8_t releaseLevel)
+{
+ int8_t weight=filterLevel(i)-releaseLevel;
+
+ //pad still counts as pressed until it drops to releaseLevel
+ if(weight<1)
+  weight=1;
+
+ //release level stays below the window, never zero
+ return (uint16_t)((uint32_t)mouseSpeed*weight/(BUFFER_BYTES*8-releaseLevel));
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//								TURBO 								//
+//																	//
+// Function Name : turboKey()										//
+// return type : void												//
+// argument : key number (0 to NUM_KEYS-1),						//
+//			  pressed 1 or released 0								//
+// 																	//
+// Function Name : turboReport()									//
+// return type : void												//
+// argument : void													//
+// 																	//
+// USE:																//
+// 	turboKey() only marks the key, nothing is sent from here. first	//
+//	turbo key starts a new press phase. turboReport() puts the		//
+//	keys of held turbo keys into keyboard report while phase is		//
+//	pressed and takes them out otherwise, other keys stay as they	//
+//	are. it is called right before the report goes out				//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if TURBO_KEYS
+static void turboKey(uint8_t key, uint8_t pressed)
+{
+ if(pressed)
+  {
+   if(!turboHeld)
+    {
+     turboTime=0;
+     turboPhase=1;
+    }
+   turboHeld|=1<<key;
+  }
+ else
+  turboHeld&=~(1<<key);
+
+ turboDirty=1;
+}
+
+static void turboReport(void)
+{
+ uint8_t i;
+
+ for(i=0;i<NUM_KEYS;i++)
+  if(((uint16_t)TURBO_KEYS>>i)&1)
+   keyboardCode(config.keymap[i],turboPhase && ((turboHeld>>i)&1));
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							BRIDGE CHECK 							//
+//																	//
+// Function Name : bridgeCheck()									//
+// return type : uint8_t, 1 if press is only a bridge				//
+// argument : key number which just went over press level			//
+// 																	//
+// USE:																//
+// 	hand or water across two neighbour pins makes them one node,	//
+//	both go over press level few scans apart with nearly the same	//
+//	24 samples. two real touches start at different times and		//
+//	noise of two fingers differs. only neighbours are checked and	//
+//	only on a press, so normal scans cost nothing					//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if BRIDGE_DETECT
+static uint8_t bridgeCheck(uint8_t i)
+{
+ uint8_t k,a,n,j,diff,bits;
+
+ for(k=0;k<2;k++)
+  {
+   if(k==0)
+    {
+     if(i==0)
+      continue;
+     a=i-1;			//pair below
+     n=i-1;
+    }
+   else
+    {
+     a=i;			//pair above
+     n=i+1;
+     if(n>=TOTAL_KEYS)
+      continue;
+    }
+
+   if(!pinNeighbours(a) || !inputs[n].pressed || inputs[n].bridged)
+    continue;
+   if(inputs[n].age>BRIDGE_ONSET_SCANS)
+    continue;
+
+   bits=0;
+   for(j=0;j<BUFFER_BYTES;j++)
+    {
+     diff=inputs[i].measurementBuffer[j]^inputs[n].measurementBuffer[j];
+     for(;diff;diff&=diff-1)
+      bits++;
+    }
+
+   if(bits<=BRIDGE_DIFF_BITS)
+    {
+     if(bridgeCount[a]!=0xff)
+      bridgeCount[a]++;
+     return 1;
+    }
+  }
+
+ return 0;
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							PACK PRESSED							//
+//																	//
+// Function Name : packPressed()									//
+// return type : void												//
+// argument : 3 bytes for the bits									//
+// 																	//
+// USE:																//
+// 	pressed flag of every key as one bit, key 0 is bit 0 of byte 0.	//
+//	used for gamepad report and for frame of a secondary board		//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if HID_GAMEPAD || LINK_MODE==LINK_SECONDARY
+static void packPressed(uchar *state)
+{
+ uint8_t i;
+
+ state[0]=state[1]=state[2]=0;
+
+ for(i=0;i<TOTAL_KEYS;i++)
+#if BRIDGE_DETECT
+  if(inputs[i].pressed && !inputs[i].bridged)
+#else
+  if(inputs[i].pressed)
+#endif
+   state[i>>3]|=1<<(i&7);
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							LINK CRC								//
+//																	//
+// Function Name : linkCrc()										//
+// return type : uchar												//
+// argument : frame													//
+// 																	//
+// USE:																//
+// 	crc8 of all bytes of a frame but last one, last one carries it	//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if LINK_MODE!=LINK_NONE
+static uchar linkCrc(const uchar *frame)
+{
+ uint8_t i;
+ uchar crc=0;
+
+ for(i=0;i<LINK_FRAME-1;i++)
+  crc=_crc8_ccitt_update(crc,frame[i]);
+
+ return crc;
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							EXPANSION								//
+//																	//
+// Function Name : expandScan()										//
+// return type : uint8_t, 1 if any expansion pad was touched		//
+// argument : void													//
+// 																	//
+// Function Name : expandKeys()										//
+// return type : void												//
+// argument : void													//
+// 																	//
+// USE:																//
+// 	expandScan() latches all pads of the chain at the same moment	//
+//	and shifts them in, one SPI byte per chip. averages are			//
+//	updated on the fly, so no buffer for the raw bits is needed.	//
+//	expandKeys() runs the thresholds and puts changed pads into		//
+//	keyboard report by expandKeymap, sent when endpoint is free		//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if EXPAND_CHIPS
+static uint8_t expandScan(void)
+{
+ uint8_t c,n,bits,touched=0;
+ uint8_t *average=expandAverage;
+
+ PORTB&=~(1<<PB2);		//load, 20ns is enough, this is 80ns
+ PORTB|=(1<<PB2);		//shift, QH of first chip has pad H now
+
+ for(c=0;c<EXPAND_CHIPS;c++)
+  {
+   SPDR=0;
+   while(!(SPSR&(1<<SPIF)));
+   bits=~SPDR;			//msb first, bit n is pad n. touched pad reads low
+
+   touched|=bits;
+   for(n=0;n<8;n++,average++,bits>>=1)
+     *average=emaStep(*average,bits&1);
+  }
+
+ return touched!=0;
+}
+
+static void expandKeys(void)
+{
+ uint8_t k,level,mask,*pressed;
+
+ for(k=0;k<EXPAND_PADS;k++)
+  {
+   level=((uint16_t)expandAverage[k]*(BUFFER_BYTES*8)+128)>>8;
+   pressed=&expandPressed[k>>3];
+   mask=1<<(k&7);
+
+   if((*pressed&mask) && level<config.releaseThreshold)
+    {
+     *pressed&=~mask;
+     keyboardCode(pgm_read_byte(&expandKeymap[k]),0);
+     expandDirty=1;
+    }
+   else if(!(*pressed&mask) && level>config.pressThreshold)
+    {
+     *pressed|=mask;
+     keyboardCode(pgm_read_byte(&expandKeymap[k]),1);
+     expandDirty=1;
+    }
+  }
+
+ //endpoint busy keeps it dirty, goes out on a later scan
+ if(expandDirty && usbInterruptIsReady())
+  {
+   usbSetInterrupt(reportBufferKeyboard,sizeof(reportBufferKeyboard));
+   expandDirty=0;
+  }
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//								keyPressed 							//
+//																	//
+// Function Name : keyPressed()										//
+// return type : static uchar (unsigned char)						//						//
+// argument : NULL													//
+// 																	//
+// USE:																//
+// 	This function actually has moving average filter and finds		//
+//	whether the keys are pressed or release							//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+static uchar keyPressed(void)
+{
+ uint8_t i,n,newMeasurement,touched=0;
+#if !HID_GAMEPAD && !MOUSE_ABSOLUTE
+ int8_t dx,dy,x,y;
+#endif
+ uint16_t scanEnd=SCAN_TICKS;
+ int8_t level,pressLevel,releaseLevel;
+
+ if(activeDirty)
+  activeBuild();
+
+#if ADC_SENSE
+ //results of last round are used below, next round runs meanwhile
+ if(adcChannel==ADC_PADS)
+  {
+   adcChannel=0;
+   adcSettle=ADC_DISCARD;
+   ADMUX=ADC_MUX(0);
+   ADCSRA|=(1<<ADSC);
+  }
+#endif
+
+#if FILTER_EMA
+
+ //average moves 1/8 of the way to 0 or to 255 per sample, see emaStep()
+ for(n=0;n<activeCount;n++)
+  {
+   i=activeList[n];
+   newMeasurement=readInput(i);
+   touched|=newMeasurement;
+#if FAST_ATTACK
+   if(!newMeasurement)
+    inputs[i].run=0;
+   else if(inputs[i].run!=0xff)
+    inputs[i].run++;
+#endif
+
+   inputs[i].average=emaStep(inputs[i].average,newMeasurement);
+  }
+
+#else
+
+ uint8_t currentByte,currentMeasurement;
+
+ for(n=0;n<activeCount;n++)
+  {
+   i=activeList[n];
+   currentByte=inputs[i].measurementBuffer[byteCounter];
+
+   inputs[i].oldestMeasurement=(currentByte>>bitCounter)&0x01;
+   
+   newMeasurement=readInput(i);
+   touched|=newMeasurement;
+#if FAST_ATTACK
+   if(!newMeasurement)
+    inputs[i].run=0;
+   else if(inputs[i].run!=0xff)
+    inputs[i].run++;
+#endif
+
+   if(newMeasurement)
+    currentByte |= (1<<bitCounter);
+   else
+    currentByte &= ~(1<<bitCounter);
+   
+   inputs[i].measurementBuffer[byteCounter] = currentByte;
+  }
+   //update buffer sums
+ for(n=0;n<activeCount;n++)
+  {
+   i=activeList[n];
+   currentByte=inputs[i].measurementBuffer[byteCounter];
+   currentMeasurement=(currentByte>>bitCounter)&0x01;
+   if(currentMeasurement)
+    inputs[i].bufferSum++;
+   
+   if(inputs[i].oldestMeasurement)
+    inputs[i].bufferSum--;
+  }
+  
+   bitCounter++;
+   if(bitCounter==8)
+    {
+	 bitCounter=0;
+	 byteCounter++;
+	 if(byteCounter==BUFFER_BYTES)
+	  byteCounter=0;
+	}
+
+#endif
+    
+#if ADAPTIVE_BASELINE
+	baselineCounter++;
+#endif
+#if EXPAND_CHIPS
+	touched|=expandScan();
+#endif
+
+	for(n=0;n<activeCount;n++)
+	{
+	 i=activeList[n];
+	 level=filterLevel(i);
+
+#if BRIDGE_DETECT
+	 if(inputs[i].age!=0xff)
+	  inputs[i].age++;		//stops, so a key held long never looks new again
+#endif
+#if ADAPTIVE_BASELINE
+	 //leakage of wet or long wired pads raises idle level slowly, a touch
+	 //raises it within few scans. so follow the slow part only while the
+	 //key is released and move both thresholds up by it, gap stays same
+
+	 if(!inputs[i].pressed && !(baselineCounter&(BASELINE_DIVIDER-1)))
+	  inputs[i].baseline+=(((int16_t)level<<BASELINE_SHIFT)-(int16_t)inputs[i].baseline+(1<<(BASELINE_SHIFT-1)))>>BASELINE_SHIFT;
+
+	 pressLevel=config.pressThreshold+((inputs[i].baseline+(1<<(BASELINE_SHIFT-1)))>>BASELINE_SHIFT);
+	 if(pressLevel>BUFFER_BYTES*8-1)
+	  pressLevel=BUFFER_BYTES*8-1;	//key must still be able to press
+	 releaseLevel=pressLevel-(config.pressThreshold-config.releaseThreshold);
+#else
+	 pressLevel=config.pressThreshold;
+	 releaseLevel=config.releaseThreshold;
+#endif
+#if CHATTER_GUARD
+	 releaseLevel-=chatter.widen[i];
+	 if(releaseLevel<1)
+	  releaseLevel=1;		//level 0 must still release
+#endif
+
+#if MOUSE_INTENSITY
+	 if(i>=12 && i<16)
+	  mouseRelease[i-12]=releaseLevel;	//intensitySpeed() measures from here
+#endif
+
+	 if (inputs[i].pressed)
+	  {
+	 	if(level<releaseLevel) //release key
+	  	 { 
+		    inputs[i].pressed = 0;
+
+#if BRIDGE_DETECT
+			if(inputs[i].bridged)
+			 {
+			  inputs[i].bridged=0;
+			  continue;		//never sent, nothing to release
+			 }
+#endif
+#if HID_GAMEPAD || LINK_MODE==LINK_SECONDARY
+			continue;		//report is built from pressed flags below
+#endif
+			if(i==16)
+			 releaseMouse(LEFT_BUTTON); //release left and right mouse button
+			else if(i==17)
+			 releaseMouse(RIGHT_BUTTON);
+  			else if(i==15)
+			 xPositive = 0; //right arrow
+			else if(i==14)
+			 xNegative = 0; //left arrow
+			else if(i==13)
+			 yNegative = 0; //up arrow
+			else if(i==12)
+			 yPositive =0;  //down arrow
+#if SWIPE_SCROLL
+			else if(i>=SWIPE_FIRST && i<SWIPE_FIRST+SWIPE_PADS)
+			 ;				//strip pads send no keys
+#endif
+#if TURBO_KEYS
+			else if(i<NUM_KEYS && (((uint16_t)TURBO_KEYS>>i)&1))
+			 turboKey(i,0);
+#endif
+			else
+	  		 releaseKey(i+1);
+			//return 0;
+	  	 }
+      }
+      else if(!inputs[i].pressed)
+	  {
+#if FAST_ATTACK
+		if(level<=pressLevel && inputs[i].run>=FAST_ATTACK_RUN)
+		 {
+		  //press now and fill filter up to press level, so release
+		  //goes through the same hysteresis as a normal press
+		  raiseFilter(i,pressLevel+1);
+		  level=pressLevel+1;
+		 }
+#endif
+	    if(level>pressLevel) //press key
+		 {
+        	inputs[i].pressed = 1;
+			
+#if CHATTER_GUARD
+			if(chatter.presses[i]!=0xff)
+			 chatter.presses[i]++;
+#endif
+#if BRIDGE_DETECT
+			inputs[i].age=0;
+			if(bridgeCheck(i))
+			 {
+			  inputs[i].bridged=1;
+			  continue;		//second pin of same bridge, not a key
+			 }
+#endif
+#if HID_GAMEPAD || LINK_MODE==LINK_SECONDARY
+			continue;
+#endif
+			if(i==16)
+			 pressMouse(LEFT_BUTTON); //click left mouse button
+			else if(i==17)
+			 pressMouse(RIGHT_BUTTON); //right click
+#if MOUSE_ABSOLUTE
+			else if(i>=12 && i<=15)
+			 pointerTarget=i-11;		//sent below as soon as endpoint is free
+#endif
+			else if(i==15)
+			 xPositive=1;
+			else if(i==14)
+			 xNegative=1;
+			else if(i==13)
+			 yNegative=1;
+			else if(i==12)
+			 yPositive=1;
+#if SWIPE_SCROLL
+			else if(i>=SWIPE_FIRST && i<SWIPE_FIRST+SWIPE_PADS)
+			 swipePad(i-SWIPE_FIRST);
+#endif
+#if TURBO_KEYS
+			else if(i<NUM_KEYS && (((uint16_t)TURBO_KEYS>>i)&1))
+			 turboKey(i,1);		//sent from turbo section, never waits
+#endif
+			else
+			 pressKey(i+1);
+			//return 1;
+		 }
+	  }
+	 
+	}
+
+#if EXPAND_CHIPS
+	expandKeys();
+#endif
+
+#if CHATTER_GUARD
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//								CHATTER								//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+chatterTime+=(uint16_t)(TCNT1-chatterLastTime);
+chatterLastTime=TCNT1;
+
+if(chatterTime>=CHATTER_WINDOW_TICKS)
+ {
+  chatterTime-=CHATTER_WINDOW_TICKS;
+
+  for(i=0;i<TOTAL_KEYS;i++)
+   {
+    if(chatter.presses[i]>CHATTER_BUDGET)
+     {
+      if(chatter.widen[i]<CHATTER_MAX_WIDEN)
+       chatter.widen[i]++;
+      if(chatter.overBudget[i]!=0xff)
+       chatter.overBudget[i]++;
+     }
+    else if(!chatter.presses[i] && chatter.widen[i])
+     chatter.widen[i]--;
+
+    chatter.presses[i]=0;
+   }
+ }
+
+#endif
+
+#if TURBO_KEYS
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//								TURBO								//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+//phase flips every TURBO_HALF_TICKS of timer1. time left over is kept,
+//so a late scan or busy endpoint does not shift the following flips
+
+if(turboHeld)
+ {
+  turboTime+=(uint16_t)(TCNT1-turboLastTime);
+  while(turboTime>=TURBO_HALF_TICKS)
+   {
+    turboTime-=TURBO_HALF_TICKS;
+    turboPhase^=1;
+    turboDirty=1;
+   }
+ }
+turboLastTime=TCNT1;
+
+//endpoint busy keeps it dirty, goes out on a later scan
+if(turboDirty && usbInterruptIsReady())
+ {
+  turboReport();
+  usbSetInterrupt(reportBufferKeyboard,sizeof(reportBufferKeyboard));
+  turboDirty=0;
+ }
+
+#endif
+
+#if LINK_MODE==LINK_SECONDARY
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							  LINK FRAME							//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+//new frame every scan, sequence tells primary that we are still scanning
+
+{
+ static uchar seq = 0;
+ uchar frame[LINK_FRAME];
+
+ frame[0]=++seq;
+ packPressed(frame+1);
+ frame[LINK_FRAME-1]=linkCrc(frame);
+
+ cli();
+ for(i=0;i<LINK_FRAME;i++)
+  linkFrame[i]=frame[i];
+ sei();
+}
+
+#endif
+
+#if HID_GAMEPAD
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							  GAMEPAD REPORT						//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+//whole state goes in one report when it changed. if endpoint is still
+//busy report stays different and goes out on a later scan
+
+{
+ uchar state[3];
+
+ packPressed(state);
+
+ if((state[0]!=reportBufferGamepad[0] || state[1]!=reportBufferGamepad[1] ||
+     state[2]!=reportBufferGamepad[2]) && usbInterruptIsReady())
+  {
+   reportBufferGamepad[0]=state[0];
+   reportBufferGamepad[1]=state[1];
+   reportBufferGamepad[2]=state[2];
+   usbSetInterrupt(reportBufferGamepad,sizeof(reportBufferGamepad));
+  }
+}
+
+#elif MOUSE_ABSOLUTE
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							  MOUSE POSITION						//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+//last touched pad wins, endpoint busy keeps it for next scan
+
+if(pointerTarget && pointTo(pointerTarget-1))
+ pointerTarget=0;
+
+#else
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							  MOUSE MOVEMENTS						//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+
+//mouse speed
+
+if(xPositive || xNegative ||  yPositive || yNegative)
+{
+ mouseTime+=(uint16_t)(TCNT1-mouseLastTime);
+ while(mouseTime>=MOUSE_STEP_TICKS && mouseStep<sizeof(mouseCurve)/sizeof(mouseCurve[0])-1)
+  {
+   mouseTime-=MOUSE_STEP_TICKS;
+   mouseStep++;
+  }
+
+ mouseSpeed=pgm_read_word(&mouseCurve[mouseStep]);
+ if(mouseSpeed>(MOUSE_MAX_SPEED<<MOUSE_FRACTION_BITS))
+  mouseSpeed=MOUSE_MAX_SPEED<<MOUSE_FRACTION_BITS;
+}
+mouseLastTime=TCNT1;
+
+
+//direction on both axes, diagonal when one pad of each axis is held
+
+dx=xPositive-xNegative;
+dy=yPositive-yNegative;
+
+#if SWIPE_SCROLL
+//time from timer1 like mouse speed, so scan period does not change it
+if(swipeTime<SWIPE_TIMEOUT)
+ swipeTime+=(uint16_t)(TCNT1-swipeLastTime);
+swipeLastTime=TCNT1;
+
+//scroll without pointer motion needs a report of its own
+if(mouseWheel && !dx && !dy)
+ moveMouse(0,0);
+#endif
+
+if(dx || dy)
+ {
+  //speed has MOUSE_FRACTION_BITS below one count, fraction is carried to
+  //next report. only reports which really go out take motion, so slow
+  //speeds come out as a count every few reports, not as lost motion
+  if(usbInterruptIsReady())
+   {
+#if MOUSE_INTENSITY
+    //x+ is pad 15, x- 14, y+ 12, y- 13
+    i=xPositive?15:14;
+    mouseFractionX+=dx*intensitySpeed(i,mouseRelease[i-12]);
+    i=yPositive?12:13;
+    mouseFractionY+=dy*intensitySpeed(i,mouseRelease[i-12]);
+#else
+    mouseFractionX+=dx*(int16_t)mouseSpeed;
+    mouseFractionY+=dy*(int16_t)mouseSpeed;
+#endif
+
+	//divide rounds toward zero in both directions, >> would move left/up early
+	x=mouseFractionX/(1<<MOUSE_FRACTION_BITS);
+	y=mouseFractionY/(1<<MOUSE_FRACTION_BITS);
+	mouseFractionX-=(int16_t)x*(1<<MOUSE_FRACTION_BITS);
+	mouseFractionY-=(int16_t)y*(1<<MOUSE_FRACTION_BITS);
+
+	moveMouse(x,y);
+   }
+ }
+
+//released direction stops cursor and starts acceleration again
+
+if((xposonTime && !xPositive) || (xnegonTime && !xNegative) ||
+   (yposonTime && !yPositive) || (ynegonTime && !yNegative))
+ {
+  moveMouse(0,0);
+  mouseTime=0;
+  mouseStep=0;
+  mouseFractionX=0;
+  mouseFractionY=0;
+ }
+
+xposonTime=xPositive;
+xnegonTime=xNegative;
+yposonTime=yPositive;
+ynegonTime=yNegative;
+
+#endif
+
+
+
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							  SCAN PERIOD							//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+//with fixed period hum on the 10M inputs is sampled at the same phase
+//again and again and shows up as slow false press. random period spreads
+//samples over the whole mains cycle so window averages hum out
+
+#if IDLE_SLEEP
+//nobody touched anything for a while, scan slower. first touched sample
+//brings back full rate on next scan
+if(touched)
+ idleScans=0;
+else if(idleScans<IDLE_SCANS)
+ idleScans++;
+
+if(idleScans>=IDLE_SCANS)
+ scanEnd=SCAN_TICKS*IDLE_SCAN_FACTOR;
+#endif
+
+#if HUM_DITHER
+ditherState=(ditherState>>1)^(-(ditherState&1)&0xb8);	//8 bit galois lfsr
+scanEnd=scanEnd-HUM_DITHER_TICKS+(uint16_t)(((uint32_t)ditherState*HUM_DITHER_TICKS)>>7);
+#endif
+
+scanPeriod=scanEnd+1;	//scheduler waits (or sleeps) for it
+
+
+return 0;
+
+}
+
+/////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							USB SUSPEND								//
+//																	//
+// Function Name : usbSuspend()										//
+// return type : void												//
+// argument : void													//
+// 																	//
+// USE:																//
+// 	called when keep-alive stopped. sleeps until host resumes or	//
+//	until a pad is touched, then signals remote wakeup if host		//
+//	allowed it. watchdog is off meanwhile, 2s would reset us.		//
+//	keep crystal start-up fuses short so we wake in time for resume	//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if USB_SUSPEND
+static void usbSuspend(void)
+{
+ uint8_t sof=usbSofCount, touched=0, isc=EXT_INT_CONTROL&0x0f;
+#if SUSPEND_SLOW_SCAN || ADC_SENSE || PIN_CHANGE_WAKE
+ uint8_t i;
+#endif
+
+ wdt_disable();
+
+#if ADC_SENSE
+ //adc would draw current all the time, PC0-PC5 do not wake us meanwhile
+ cli();
+ ADCSRA&=~((1<<ADEN)|(1<<ADIE));
+ adcChannel=ADC_PADS;
+ for(i=0;i<ADC_PADS;i++)
+  analog.value[i]=0xff;
+ sei();
+#endif
+
+#if SUSPEND_SLOW_SCAN
+ TCCR1B=0;
+ TCNT1=0;
+ OCR1A=SUSPEND_SCAN_TICKS;
+ TCCR1B=(1<<WGM12)|(1<<CS12)|(1<<CS10);	//clear on compare, F_CPU/1024
+ TIMER1_MASK|=(1<<OCIE1A);
+ set_sleep_mode(SLEEP_MODE_IDLE);
+#else
+ //only low level on INT0/INT1 wakes ATmega8 from power-down. D- goes low
+ //on resume and reset, pad on PD3 goes low when touched
+ EXT_INT_CONTROL&=~((1<<ISC11)|(1<<ISC10)|(1<<ISC01)|(1<<ISC00));
+#if PIN_CHANGE_WAKE
+ //newer parts also wake on pin change, any pad not masked out will do
+ PCMSK0=0;
+ PCMSK1=0;
+ PCMSK2=0;
+ for(i=0;i<TOTAL_KEYS;i++)
+  if(inputActive(i))
+   {
+    if(i<6)
+     PCMSK0|=1<<i;
+    else if(i<12 && !ADC_SENSE)
+     PCMSK1|=1<<(i-6);
+    else if(i==12)
+     PCMSK2|=1<<1;			//pd1
+    else if(i>12)
+     PCMSK2|=1<<(i-10);		//pd3 to pd7
+   }
+ if(usbRemoteWakeup)
+  PCICR=(1<<PCIE0)|(1<<PCIE1)|(1<<PCIE2);
+#endif
+ set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+#endif
+
+ for(;;)
+  {
+   cli();
+   if(usbSofCount!=sof || !(USBIN&(1<<USBMINUS)))
+    break;	//keep-alive again or host drives K/SE0, bus is awake
+   if(touched && usbRemoteWakeup)
+    break;
+#if !SUSPEND_SLOW_SCAN && !PIN_CHANGE_WAKE
+   if(usbRemoteWakeup && inputActive(13))	//shorted PD3 would wake us at once
+    EXT_INT_MASK|=(1<<INT1);				//isr turns it off again
+#endif
+   sleep_enable();
+   sei();
+   sleep_cpu();
+   cli();		//low level on D- keeps firing INT0 until we are back to normal
+   sleep_disable();
+
+#if SUSPEND_SLOW_SCAN || PIN_CHANGE_WAKE
+   for(i=0;i<TOTAL_KEYS;i++)
+    touched|=inputActive(i) && readInput(i);
+#if EXPAND_CHIPS && SUSPEND_SLOW_SCAN
+   touched|=expandScan();	//one sample moves average, raw bits tell touch
+#endif
+#else
+   touched=inputActive(13) && readInput(13);	//pd3
+#endif
+  }
+
+ //back to normal, interrupts are still off here
+ EXT_INT_CONTROL=(EXT_INT_CONTROL&0xf0)|isc;
+ EXT_INT_MASK&=~(1<<INT1);
+ EXT_INT_FLAGS=(1<<INTF1);
+#if PIN_CHANGE_WAKE
+ PCICR=0;
+ PCIFR=(1<<PCIF0)|(1<<PCIF1)|(1<<PCIF2);
+#endif
+ set_sleep_mode(SLEEP_MODE_IDLE);
+ TCCR1B=(1<<CS11);	//free running again, caller restarts the tasks
+#if ADC_SENSE
+ ADCSRA|=(1<<ADEN)|(1<<ADIE);
+#endif
+#if !IDLE_SLEEP
+ TIMER1_MASK&=~(1<<OCIE1A);
+#endif
+ sei();
+
+ if(touched && usbRemoteWakeup)
+  {
+   //pad held when suspend started gets here right away
+   _delay_ms(REMOTE_WAKEUP_WAIT_MS);
+
+   //remote wakeup is K state (D- low, D+ high) driven by us for 1-15ms,
+   //not needed if host resumed meanwhile
+   cli();
+   if(usbSofCount==sof && (USBIN&(1<<USBMINUS)))
+    {
+     USBOUT=(USBOUT&~USBMASK)|(1<<USBPLUS);
+     USBDDR|=USBMASK;
+     _delay_ms(REMOTE_WAKEUP_MS);
+     USBDDR&=~USBMASK;
+     USBOUT&=~USBMASK;
+     USB_INTR_PENDING=(1<<USB_INTR_PENDING_BIT);	//our own K is not a packet
+    }
+   sei();
+  }
+
+ wdt_enable(WDTO_2S);
+}
+#endif
+
+/////////////////////////////////////////////////////////////////////
+
+#if IDLE_SLEEP || (USB_SUSPEND && SUSPEND_SLOW_SCAN)
+EMPTY_INTERRUPT(TIMER1_COMPA_vect);	//only here to wake cpu when next task is due
+#endif
+
+#if USB_SUSPEND && !SUSPEND_SLOW_SCAN
+#if PIN_CHANGE_WAKE
+EMPTY_INTERRUPT(PCINT0_vect);		//only here to wake cpu from power-down on touch
+EMPTY_INTERRUPT(PCINT1_vect);
+EMPTY_INTERRUPT(PCINT2_vect);
+#else
+//only here to wake cpu from power-down on touch. low level would fire
+//again and again while pad is held, so it turns itself off
+ISR(INT1_vect)
+{
+ EXT_INT_MASK&=~(1<<INT1);
+}
+#endif
+#endif
+
+#if ADC_SENSE
+//store result and start next pad until round is done. no blocking, so usb
+//interrupt may come in while we are here
+ISR(ADC_vect, ISR_NOBLOCK)
+{
+ uint8_t c=adcChannel;
+
+ if(adcSettle)		//sample and hold still had charge of last channel
+  {
+   adcSettle--;
+   ADCSRA|=(1<<ADSC);
+   return;
+  }
+
+ analog.value[c]=ADCH;
+ if(++c<ADC_PADS)
+  {
+   ADMUX=ADC_MUX(c);
+   adcSettle=ADC_DISCARD;
+   ADCSRA|=(1<<ADSC);
+  }
+ adcChannel=c;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							  TASKS									//
+//																	//
+//////////////////////////////////////////////////////////////////////
+
+static void usbTask(void);
+static void scanTask(void);
+static void idleTask(void);
+#if LINK_MODE==LINK_PRIMARY
+static void linkTask(void);
+#endif
+
+//one run of any task may come before a due one, and timer1 ticks are
+//compared unsigned, so start must be found late within half a wrap
+#define TASK_DEADLINE_OK(d)	((d)>TASK_USB_BUDGET && (d)>TASK_SCAN_BUDGET && (d)>TASK_CONFIG_BUDGET && \
+							 (d)>TASK_IDLE_BUDGET && (LINK_MODE!=LINK_PRIMARY || (d)>TASK_LINK_BUDGET))
+#define TASK_TICKS_OK(p,d)	((p)+(d)<0x8000UL)
+
+#if !TASK_DEADLINE_OK(TASK_USB_DEADLINE) || !TASK_DEADLINE_OK(TASK_SCAN_DEADLINE) || \
+	!TASK_DEADLINE_OK(TASK_CONFIG_DEADLINE) || !TASK_DEADLINE_OK(TASK_IDLE_DEADLINE) || \
+	(LINK_MODE==LINK_PRIMARY && !TASK_DEADLINE_OK(TASK_LINK_DEADLINE))
+#error "task deadline must be longer than budget of every task"
+#endif
+#if !TASK_TICKS_OK(TASK_USB_PERIOD,TASK_USB_DEADLINE) || !TASK_TICKS_OK(SCAN_TICKS*IDLE_SCAN_FACTOR,TASK_SCAN_DEADLINE) || \
+	!TASK_TICKS_OK(TASK_CONFIG_PERIOD,TASK_CONFIG_DEADLINE) || !TASK_TICKS_OK(TASK_IDLE_PERIOD,TASK_IDLE_DEADLINE) || \
+	(LINK_MODE==LINK_PRIMARY && !TASK_TICKS_OK(LINK_PERIOD,TASK_LINK_DEADLINE))
+#error "task period plus deadline too long for timer1 at this F_CPU"
+#endif
+
+struct task tasks[TASKS] = {
+ {usbTask,		TASK_USB_PERIOD,	TASK_USB_DEADLINE,		TASK_USB_BUDGET,	0},
+ {scanTask,		SCAN_TICKS+1,		TASK_SCAN_DEADLINE,		TASK_SCAN_BUDGET,	0},
+ {configTask,	TASK_CONFIG_PERIOD,	TASK_CONFIG_DEADLINE,	TASK_CONFIG_BUDGET,	0},
+ {idleTask,		TASK_IDLE_PERIOD,	TASK_IDLE_DEADLINE,		TASK_IDLE_BUDGET,	0},
+#if LINK_MODE==LINK_PRIMARY
+ {linkTask,		LINK_PERIOD,		TASK_LINK_DEADLINE,		TASK_LINK_BUDGET,	0},
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//						RESTART ALL TASKS							//
+//																	//
+// Function Name : taskRestart()									//
+// return type : void												//
+// argument : void													//
+// 																	//
+// USE:																//
+// 	make every task due now, used after timer1 was stopped			//
+//  																//
+//////////////////////////////////////////////////////////////////////
+
+#if USB_SUSPEND
+static void taskRestart(void)
+{
+ uint8_t i;
+
+ for(i=0;i<TASKS;i++)
+  tasks[i].lastRun=TCNT1-tasks[i].period;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							USB TASK								//
+//																	//
+// Function Name : usbTask()										//
+// return type : void												//
+// argument : void													//
 // 																	//
 // USE:																//
-// 	use to press mouse button event in computer						//
+// 	polls usb driver and goes to suspend when keep-alive stops		//
 //  																//
 //////////////////////////////////////////////////////////////////////
 
-void pressMouse(uint8_t button)
+static void usbTask(void)
 {
+#if USB_SUSPEND
+ static uchar lastSofCount = 0, sofTime = 0;
+#endif
 
-   reportBufferMouse[0]=2; //this is report id
+#if LINK_MODE==LINK_SECONDARY
+ return;		//no usb on secondary board
+#endif
 
-   if(button==0)
-    button_state=0b00000000;   	  //this is buttons
-   else if(button==1) 			  //left button click
-    button_state=0b00000001;	  
-   else if(button==2)			  //right button click
-    button_state=0b00000010;
-   else if(button==3)			  //middle button click
-    button_state=0b00000100;
-   
-   reportBufferMouse[1]=button_state;   //button state, to enable click drag feature
-   reportBufferMouse[2]=0; 				//do not move on x axis
-   reportBufferMouse[3]=0; 				//do not move on y axis
+ usbPoll();		//This function must be called at least once in 50ms
 
-   //while(!usbInterruptIsReady()); //wait until interrupt is ready
-   
-   //wait until interrupt is ready
-   if(usbInterruptIsReady())
-   //this function actually sends the reportBuffer data
-   	usbSetInterrupt(reportBufferMouse,sizeof(reportBufferMouse));
- 
+#if USB_SUSPEND
+ if(usbSofCount != lastSofCount)	//host is still there
+  {
+   lastSofCount = usbSofCount;
+   sofTime = TCNT0;
+  }
+ else if((uchar)(TCNT0 - sofTime) > SUSPEND_TICKS)
+  {
+   usbSuspend();
+   lastSofCount = usbSofCount;
+   sofTime = TCNT0;
+   taskRestart();
+  }
+#endif
 }
 
-////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////////////////////
 //																	//
-//						RELEASE MOUSE KEYS							//
+//							SCAN TASK								//
 //																	//
-// Function Name : releaseKey()										//
+// Function Name : scanTask()										//
 // return type : void												//
-// argument : key (same as pressMouse function description)			//
+// argument : void													//
 // 																	//
 // USE:																//
-// 	use to relase mouse key press event in computer					//
+// 	scans keys, keyPressed() tells when it wants to run again		//
 //  																//
 //////////////////////////////////////////////////////////////////////
 
-void releaseMouse(uint8_t key)
+static void scanTask(void)
 {
-   //reset appropriate bit from 3 bits
-   button_state&=~key;   
-
-   reportBufferMouse[0]=2; //this is report id
-
-   reportBufferMouse[1]=button_state;   //this is buttons
-
-   reportBufferMouse[2]=0; //do not move on x axis
-   reportBufferMouse[3]=0; //do not move on y axis
-
-   //while(!usbInterruptIsReady()); //wait until interrupt is ready
-   
-   //wait until interrupt is ready
-   if(usbInterruptIsReady())
-   //this function actually sends the reportBuffer data
-   	usbSetInterrupt(reportBufferMouse,sizeof(reportBufferMouse));
+ keyPressed();	//check for key pressed
 
+ tasks[TASK_SCAN].period=scanPeriod;
 }
 
-/////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////////////////////
 //																	//
-//								MOVE MOUSE 							//
+//							IDLE TASK								//
 //																	//
-// Function Name : moveMouse()										//
+// Function Name : idleTask()										//
 // return type : void												//
-// argument : x +ve values moves to +ve x axis and vice-versa		//
-//			  y +ve values moves to +ve y axis and vice-versa		//
+// argument : void													//
 // 																	//
 // USE:																//
-// 	use to relase mouse key press event in computer					//
+// 	counts down hid idle rate every 4ms								//
 //  																//
 //////////////////////////////////////////////////////////////////////
 
-void moveMouse(int8_t x, int8_t y)
+static void idleTask(void)
 {
-
-     reportBufferMouse[0]=2;  //report id of mouse, see report descriptor for this id
-	 reportBufferMouse[1]=button_state; // to keep last state of mouse button alive
-	 reportBufferMouse[2]=x;	//move mouse cursor in x-axis
-	 reportBufferMouse[3]=y;	//move mouse cursor in y-axis
-	 
-	 //if(x==0 && y==0)
-	  //reportBufferMouse[1]=0;
-	 //while(!usbInterruptIsReady()); //wait until interrupt is ready
-
-	//wait until interrupt is ready
-	if(usbInterruptIsReady())
-	//this function actually sends the reportBuffer data
-	 usbSetInterrupt(reportBufferMouse,sizeof(reportBufferMouse));
-
+ static uchar idleCounter = 0; //device should remain idle for sometime
+
+ if(idleRate != 0){
+     if(idleCounter > 0){
+         idleCounter--;      /* 4 ms per run */
+     }else{
+         idleCounter = idleRate;
+     }
+ }
 }
 
-/////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////////////////////
 //																	//
-//								keyPressed 							//
+//							LINK TASK								//
 //																	//
-// Function Name : keyPressed()										//
-// return type : static uchar (unsigned char)						//						//
-// argument : NULL													//
+// Function Name : linkStep()										//
+// return type : uint8_t, TWI status or 0xff on timeout				//
+// argument : TWCR bits for this step besides TWINT and TWEN		//
+// 																	//
+// Function Name : linkRead()										//
+// return type : uint8_t, 1 if whole frame came in					//
+// argument : board number, buffer of LINK_FRAME bytes				//
+// 																	//
+// Function Name : linkTask()										//
+// return type : void												//
+// argument : void													//
 // 																	//
 // USE:																//
-// 	This function actually has moving average filter and finds		//
-//	whether the keys are pressed or release							//
+// 	primary reads frame of one secondary per run, TWI is polled		//
+//	with LINK_TIMEOUT per step so missing board can not hold us.	//
+//	pads which changed go into keyboard report by linkKeymap, it	//
+//	is sent as soon as endpoint is free. board without good new		//
+//	frame for LINK_LOST reads gets all its keys released			//
 //  																//
 //////////////////////////////////////////////////////////////////////
 
-static uchar keyPressed(void)
+#if LINK_MODE==LINK_PRIMARY
+static uint8_t linkStep(uint8_t control)
 {
- uint8_t i,newMeasurement=0,currentByte,currentMeasurement;
+ uint16_t start=TCNT1;
 
- for(i=0;i<TOTAL_KEYS;i++)
-  {
-   
-   currentByte=inputs[i].measurementBuffer[byteCounter];
+ TWCR=control|(1<<TWINT)|(1<<TWEN);
+ while(!(TWCR&(1<<TWINT)))
+  if((uint16_t)(TCNT1-start)>LINK_TIMEOUT)
+   return 0xff;
 
-   inputs[i].oldestMeasurement=(currentByte>>bitCounter)&0x01;
-   
-   if(i<6)
-    newMeasurement=(PINB&(1<<i));		//pin0 to 5 portb
-   else if(i>=6 && i<12)
-    newMeasurement=(PINC&(1<<(i-6)));   //this is pc0-5
-   else if(i==12)
-    newMeasurement=(PIND&(1<<1));       //this is pd1
-   else if(i>12 && i<18)
-    newMeasurement=(PIND&(1<<(i-10)));  //start from pd3 to pd7
+ return TW_STATUS;
+}
 
-   newMeasurement=!newMeasurement;
+static uint8_t linkRead(uint8_t board, uchar *frame)
+{
+ uint8_t i, ok;
 
-   if(newMeasurement)
-    currentByte |= (1<<bitCounter);
-   else
-    currentByte &= ~(1<<bitCounter);
-   
-   inputs[i].measurementBuffer[byteCounter] = currentByte;
+ ok=(linkStep(1<<TWSTA)==TW_START);
+ if(ok)
+  {
+   TWDR=((LINK_ADDRESS+board)<<1)|TW_READ;
+   ok=(linkStep(0)==TW_MR_SLA_ACK);
   }
-   //update buffer sums
- for(i=0;i<TOTAL_KEYS;i++)
+
+ //ack every byte but last, so secondary knows frame is done
+ for(i=0;ok && i<LINK_FRAME-1;i++)
   {
-   currentByte=inputs[i].measurementBuffer[byteCounter];
-   currentMeasurement=(currentByte>>bitCounter)&0x01;
-   if(currentMeasurement)
-    inputs[i].bufferSum++;
-   
-   if(inputs[i].oldestMeasurement)
-    inputs[i].bufferSum--;
+   ok=(linkStep(1<<TWEA)==TW_MR_DATA_ACK);
+   frame[i]=TWDR;
+  }
+ if(ok)
+  {
+   ok=(linkStep(0)==TW_MR_DATA_NACK);
+   frame[LINK_FRAME-1]=TWDR;
   }
-  
-   bitCounter++;
-   if(bitCounter==8)
-    {
-	 bitCounter=0;
-	 byteCounter++;
-	 if(byteCounter==BUFFER_BYTES)
-	  byteCounter=0;
-	}
-    
-	for(i=0;i<TOTAL_KEYS;i++)
-	{
 
-	 if (inputs[i].pressed)
-	  {
-	 	if(inputs[i].bufferSum<RELEASE_THRESHOLD) //release key
-	  	 { 
-		    inputs[i].pressed = 0;
+ TWCR=(1<<TWINT)|(1<<TWEN)|(1<<TWSTO);	//stop, also frees bus after error
+ return ok;
+}
 
-			if(i==16)
-			 releaseMouse(LEFT_BUTTON); //release left and right mouse button
-			else if(i==17)
-			 releaseMouse(RIGHT_BUTTON);
-  			else if(i==15)
-			 xPositive = 0; //right arrow
-			else if(i==14)
-			 xNegative = 0; //left arrow
-			else if(i==13)
-			 yNegative = 0; //up arrow
-			else if(i==12)
-			 yPositive =0;  //down arrow
-			else
-	  		 releaseKey(i+1);
-			//return 0;
-	  	 }
-      }
-      else if(!inputs[i].pressed)
-	  {
-	    if(inputs[i].bufferSum>PRESS_THRESHOLD) //press key
-		 {
-        	inputs[i].pressed = 1;
-			
-			if(i==16)
-			 pressMouse(LEFT_BUTTON); //click left mouse button
-			else if(i==17)
-			 pressMouse(RIGHT_BUTTON); //right click
-			else if(i==15)
-			 xPositive=1;
-			else if(i==14)
-			 xNegative=1;
-			else if(i==13)
-			 yNegative=1;
-			else if(i==12)
-			 yPositive=1;
-			else
-			 pressKey(i+1);
-			//return 1;
-		 }
-	  }
-	 
-	}
+static void linkTask(void)
+{
+ uint8_t b=linkBoard, i, down;
+ uchar frame[LINK_FRAME];
+ struct linkStats *stats=&linkStats[b];
 
-//////////////////////////////////////////////////////////////////////
-//																	//
-//							  MOUSE MOVEMENTS						//
-//																	//
-//////////////////////////////////////////////////////////////////////
+ if(linkRead(b,frame) && frame[LINK_FRAME-1]==linkCrc(frame))
+  {
+   stats->frames++;
+   if(frame[0]!=linkSeq[b])
+    stats->lostInRow=0;
+   else if(stats->lostInRow<LINK_LOST)
+    stats->lostInRow++;		//answers but does not scan any more
+   linkSeq[b]=frame[0];
+  }
+ else
+  {
+   if(stats->errors!=0xff)
+    stats->errors++;
+   if(stats->lostInRow<LINK_LOST)
+    stats->lostInRow++;
+   for(i=1;i<4;i++)
+    frame[i]=linkState[b][i-1];		//keep what we had
+  }
 
+ if(stats->lostInRow>=LINK_LOST)
+  frame[1]=frame[2]=frame[3]=0;		//board is gone, no stuck keys
 
-//mouse speed
+ for(i=0;i<TOTAL_KEYS;i++)
+  {
+   down=(frame[1+(i>>3)]>>(i&7))&1;
+   if(down!=((linkState[b][i>>3]>>(i&7))&1))
+    {
+     keyboardCode(pgm_read_byte(&linkKeymap[b][i]),down);
+     linkDirty=1;
+    }
+  }
 
-if(xPositive || xNegative ||  yPositive || yNegative)
-{
- mouseSpeedCounter++;
- if(mouseSpeedCounter>MOUSE_SPEED)
+ for(i=0;i<3;i++)
+  linkState[b][i]=frame[1+i];
+
+ if(++linkBoard==LINK_BOARDS)
+  linkBoard=0;
+
+ //endpoint busy keeps it dirty, goes out on a later run
+ if(linkDirty && usbInterruptIsReady())
   {
-   mouseSpeedCounter=0;
-   mouseSpeed++;
+   usbSetInterrupt(reportBufferKeyboard,sizeof(reportBufferKeyboard));
+   linkDirty=0;
   }
 }
+#endif
 
+//////////////////////////////////////////////////////////////////////
 
-//positive up xy axis movement
-if(xPositive && yNegative)
- {
-  moveMouse(mouseSpeed,-mouseSpeed);
-  //xyposuponTime=1;
- }
-
-//negative up xy axis movement
-if(xNegative && yNegative)
- {
-  moveMouse(-mouseSpeed,-mouseSpeed);
-  //xypos
- }
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							LINK SLAVE								//
+//																	//
+//	secondary answers a read of the primary with linkFrame. copy is	//
+//	taken on address match, so a scan during the read can not mix	//
+//	two frames. no usb on secondary, so this may block				//
+//																	//
+//////////////////////////////////////////////////////////////////////
 
-//positive down xy axis movement
-if(xPositive && yPositive)
- {
-  moveMouse(mouseSpeed,mouseSpeed);
- }
+#if LINK_MODE==LINK_SECONDARY
+ISR(TWI_vect)
+{
+ static uchar frame[LINK_FRAME], index;
+ uint8_t i, control=(1<<TWINT)|(1<<TWEA)|(1<<TWEN)|(1<<TWIE);
 
-//negative down xy axis movement
-if(xNegative && yPositive)
- {
-  moveMouse(-mouseSpeed,mouseSpeed);
- }
+ switch(TW_STATUS)
+  {
+   case TW_ST_SLA_ACK:
+    for(i=0;i<LINK_FRAME;i++)
+     frame[i]=linkFrame[i];
+    index=0;
+    //fall through, first byte goes out right away
+   case TW_ST_DATA_ACK:
+    TWDR=frame[index];
+    if(index<LINK_FRAME-1)
+     index++;
+    break;
+   case TW_BUS_ERROR:
+    control|=(1<<TWSTO);	//let go of the bus
+    break;
+  }
 
-//positive x axis movement
-if(xPositive)
- {
-  moveMouse(mouseSpeed,0);
-  xposonTime=1;
- }
-else if(!xPositive && xposonTime==1)
- {
-  moveMouse(0,0);
-  xposonTime=0;
-  mouseSpeedCounter=0;
-  mouseSpeed=1;
- }
+ TWCR=control;
+}
+#endif
 
-//negative x axis movement
-if(xNegative)
- {
-  moveMouse(-mouseSpeed,0);
-  xnegonTime=1;
- }
-else if(!xNegative && xnegonTime==1)
- {
-  moveMouse(0,0);
-  xnegonTime=0;
-  mouseSpeedCounter=0;
-  mouseSpeed=1;
- }
+//////////////////////////////////////////////////////////////////////
 
-//positive y axis movement
-if(yPositive)
- {
-  moveMouse(0,mouseSpeed);
-  yposonTime=1;
- }
-else if(!yPositive && yposonTime==1)
- { 
-  moveMouse(0,0);
-  yposonTime=0;
-  mouseSpeedCounter=0;
-  mouseSpeed=1;
- }
+//////////////////////////////////////////////////////////////////////
+//																	//
+//							RUN TASKS								//
+//																	//
+// Function Name : runTasks()										//
+// return type : void												//
+// argument : void													//
+// 																	//
+// USE:																//
+// 	runs first task which is due, lower number first, counts late	//
+//	starts and overruns. usb task also runs as soon as receive		//
+//	interrupt has left data in usbRxLen. if nothing was due, sleeps	//
+//	until next task is due											//
+//  																//
+//////////////////////////////////////////////////////////////////////
 
-//negative y axis movement
-if(yNegative)
- {
-  moveMouse(0,-mouseSpeed);
-  ynegonTime=1;
- }
-else if(!yNegative && ynegonTime==1)
+static void runTasks(void)
 {
- moveMouse(0,0);
- ynegonTime=0;
- mouseSpeedCounter=0;
- mouseSpeed=1;
-}
-
+ uint8_t i;
+ uint16_t now=0, elapsed, used, wait, next=0xffff;
 
+ for(i=0;i<TASKS;i++)
+  {
+   now=TCNT1;
+   elapsed=now-tasks[i].lastRun;
 
+   if(elapsed<tasks[i].period && !(i==TASK_USB && usbRxLen))
+    {
+	 wait=tasks[i].period-elapsed;
+	 if(wait<next)
+	  next=wait;
+	 continue;
+	}
 
-while(TCNT1<=1116);
-TCCR1B=0;
-TCNT1=0;
-TCCR1B=(1<<CS11);
+   //next start is one period after last one, so late starts do not add
+   //up. only a missed deadline starts counting from now again
+   if(elapsed<tasks[i].period)
+    ;		//early run for usbRxLen, keeps its time
+   else if(elapsed-tasks[i].period>tasks[i].deadline)
+    {
+	 if(taskStats[i].missed!=0xff)
+	  taskStats[i].missed++;
+	 tasks[i].lastRun=now;
+	}
+   else
+    tasks[i].lastRun+=tasks[i].period;
 
+   tasks[i].run();
 
-return 0;
+   used=TCNT1-now;
+   if(used>taskStats[i].worst)
+    taskStats[i].worst=used;
+   if(used>tasks[i].budget && taskStats[i].overruns!=0xff)
+    taskStats[i].overruns++;
+   return;	//time has passed, look again from usb task before waiting
+  }
 
+#if IDLE_SLEEP
+ //sleep until next task is due. usb interrupt wakes us too, that is how
+ //usbRxLen gets served early. sei() right before sleep makes sure compare
+ //match can not slip in between check and sleep
+ now+=next;
+ OCR1A=now;
+ cli();
+ if((int16_t)(now-TCNT1)>0 && !usbRxLen)
+  {
+   sleep_enable();
+   sei();
+   sleep_cpu();
+   sleep_disable();
+  }
+ sei();
+#endif
 }
 
-/////////////////////////////////////////////////////////////////////
-
+//////////////////////////////////////////////////////////////////////
 
 //main file
 int	main(void)
 {
 
-	uchar   idleCounter = 0; //device should remain idle for sometime
-	
+	RESET_FLAGS=0;			 //WDRF set would keep watchdog on in usbSuspend() on ATmega88 and up
 	wdt_enable(WDTO_2S); 	 //enable watchdog, in any case if restart is necesarry
 	
-	hardwareInit();			 //initialize hardware
+	configLoad();			 //keymap and thresholds from eeprom, needed by calibration
 	
 	for(uint8_t i=0;i<TOTAL_KEYS;i++) //reset all buffers and values of struct to 0
 	 {
+#if FILTER_EMA
+	  inputs[i].average=0;
+#else
 	  for(uint8_t j=0;j<BUFFER_BYTES;j++)
 	  	inputs[i].measurementBuffer[j]=0;
 
 	  inputs[i].oldestMeasurement=0;
 	  inputs[i].bufferSum=0;
+#endif
 	  inputs[i].pressed=0;
+#if ADAPTIVE_BASELINE
+	  inputs[i].baseline=0;
+#endif
 	 }
+
+	hardwareInit();			 //initialize hardware, seeds the filters
 	
-	TCCR1B=(1<<CS11);
+	TCCR1B=(1<<CS11);		 //timer1 runs free, it is the scheduler clock
+
+#if IDLE_SLEEP
+	set_sleep_mode(SLEEP_MODE_IDLE);	//timers and usb interrupt keep running
+	TIMER1_MASK|=(1<<OCIE1A);
+#endif
 
 	odDebugInit();
+#if LINK_MODE!=LINK_SECONDARY
 	usbInit();
+#endif
 
 
 	sei();
@@ -833,22 +3496,7 @@ int	main(void)
 
 	for(;;){			/* main event loop */
 		wdt_reset();
-		usbPoll();		//This function must be called at least once in 50ms
-		
-		keyPressed();	//check for key pressed
-
-        if(TIFR & (1<<TOV0)){   // 22 ms timer 
-            TIFR = 1<<TOV0;
-            if(idleRate != 0){
-                if(idleCounter > 4){
-                    idleCounter -= 5;   /* 22 ms in units of 4 ms */
-                }else{
-                    idleCounter = idleRate;
-                }
-            }
-        }
-
-      
+		runTasks();		//usb, key scan, eeprom and idle timer by their periods
 	}
 	return 0;
 }
@@ -0,0 +1,18 @@
+/* helpers shared by the tests. a test includes this, then main.c with
+ * its main() renamed, and returns checkResult() from its own main()
+ */
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int checkFailures;
+
+#define CHECK(cond)	do{ if(!(cond)){ printf("%s:%d: %s\n",__FILE__,__LINE__,#cond); checkFailures++; } }while(0)
+
+static int checkResult(void)
+{
+ return checkFailures!=0;
+}
+
+#endif
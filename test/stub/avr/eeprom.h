@@ -0,0 +1,14 @@
+/* host stand-in for <avr/eeprom.h>, addresses index eepromImage in stub.c */
+#ifndef STUB_AVR_EEPROM_H
+#define STUB_AVR_EEPROM_H
+
+#include <stdint.h>
+
+#define EEMEM
+
+extern uint8_t eepromImage[];
+
+uint8_t eeprom_read_byte(const uint8_t *p);
+void eeprom_read_block(void *dst, const void *src, unsigned n);
+
+#endif
@@ -0,0 +1,12 @@
+/* host stand-in for <avr/interrupt.h>, handlers become plain functions */
+#ifndef STUB_AVR_INTERRUPT_H
+#define STUB_AVR_INTERRUPT_H
+
+#define ISR(vector, ...)		void vector(void)
+#define EMPTY_INTERRUPT(vector)	void vector(void){}
+#define ISR_NOBLOCK
+
+void sei(void);
+void cli(void);
+
+#endif
@@ -0,0 +1,141 @@
+/* host stand-in for <avr/io.h>, ATmega8 only. registers are plain
+ * variables defined in stub.c, bit numbers are those of the data sheet
+ */
+#ifndef STUB_AVR_IO_H
+#define STUB_AVR_IO_H
+
+#include <stdint.h>
+
+#ifndef REG
+#define REG(n)		extern volatile uint8_t n;
+#define REG16(n)	extern volatile uint16_t n;
+#endif
+
+REG(PORTB) REG(PORTC) REG(PORTD) REG(DDRB) REG(DDRC) REG(DDRD) REG(PINB) REG(PINC) REG(PIND)
+REG(TCCR0) REG(TCNT0) REG(TCCR1A) REG(TCCR1B) REG(TCCR2) REG(TCNT2) REG(OCR2) REG(ASSR)
+REG(TIFR) REG(TIMSK) REG(MCUCR) REG(MCUCSR) REG(GICR) REG(GIFR) REG(SFIOR) REG(SREG) REG(OSCCAL)
+REG(ADMUX) REG(ADCSRA) REG(ADCL) REG(ADCH) REG(ACSR)
+REG(EECR) REG(EEDR)
+REG(TWBR) REG(TWSR) REG(TWCR) REG(TWDR) REG(TWAR)
+REG(SPCR) REG(SPSR) REG(SPDR)
+REG(UCSRA) REG(UCSRB) REG(UCSRC) REG(UDR) REG(UBRRH) REG(UBRRL)
+REG16(OCR1A) REG16(OCR1B) REG16(ICR1) REG16(ADC) REG16(EEAR)
+
+/* timer1 moves on by timer1Step ticks at every access, so code waiting
+ * for it gets through and tests can let time pass at a chosen rate.
+ * timer1End is the value it had when it was last set back
+ */
+extern uint16_t timer1Step;
+extern uint16_t timer1End;
+volatile uint16_t *timer1Access(void);
+#define TCNT1		(*timer1Access())
+
+/* TIMSK, TIFR */
+#define TOIE0	0
+#define TOIE1	2
+#define OCIE1B	3
+#define OCIE1A	4
+#define OCIE2	7
+#define TOV0	0
+#define TOV1	2
+#define OCF1B	3
+#define OCF1A	4
+#define OCF2	7
+
+/* TCCRn */
+#define CS00	0
+#define CS01	1
+#define CS02	2
+#define CS10	0
+#define CS11	1
+#define CS12	2
+#define WGM12	3
+#define CS20	0
+#define CS21	1
+#define CS22	2
+#define WGM21	3
+
+/* MCUCR, GICR, GIFR */
+#define ISC00	0
+#define ISC01	1
+#define ISC10	2
+#define ISC11	3
+#define SM0		4
+#define SM1		5
+#define SM2		6
+#define SE		7
+#define INT0	6
+#define INT1	7
+#define INTF0	6
+#define INTF1	7
+#define PUD		2
+
+/* ADC */
+#define MUX0	0
+#define ADLAR	5
+#define REFS0	6
+#define REFS1	7
+#define ADPS0	0
+#define ADPS1	1
+#define ADPS2	2
+#define ADIE	3
+#define ADIF	4
+#define ADFR	5
+#define ADSC	6
+#define ADEN	7
+#define ACD		7
+
+/* EEPROM */
+#define EERE	0
+#define EEWE	1
+#define EEMWE	2
+#define EERIE	3
+
+/* TWI */
+#define TWIE	0
+#define TWEN	2
+#define TWSTO	4
+#define TWSTA	5
+#define TWEA	6
+#define TWINT	7
+
+/* SPI */
+#define SPR0	0
+#define SPR1	1
+#define CPHA	2
+#define CPOL	3
+#define MSTR	4
+#define DORD	5
+#define SPE		6
+#define SPIE	7
+#define SPI2X	0
+#define SPIF	7
+
+/* USART */
+#define U2X		1
+#define UDRE	5
+#define RXC		7
+#define UCSZ0	1
+#define UCSZ1	2
+#define URSEL	7
+#define TXEN	3
+#define RXEN	4
+#define RXCIE	7
+
+#define PB0		0
+#define PB1		1
+#define PB2		2
+#define PB3		3
+#define PB4		4
+#define PB5		5
+
+#define E2END		511
+#define FLASHEND	0x1fff
+#define RAMEND		0x45f
+#define __AVR_ATmega8__	1
+
+#define _BV(b)		(1<<(b))
+#define bit_is_set(r,b)	((r)&_BV(b))
+#define loop_until_bit_is_clear(r,b)	do{}while(bit_is_set(r,b))
+
+#endif
@@ -0,0 +1,14 @@
+/* host stand-in for <avr/sleep.h>, sleeping returns at once */
+#ifndef STUB_AVR_SLEEP_H
+#define STUB_AVR_SLEEP_H
+
+#define SLEEP_MODE_IDLE		0
+#define SLEEP_MODE_ADC		1
+#define SLEEP_MODE_PWR_DOWN	2
+
+void set_sleep_mode(int mode);
+void sleep_enable(void);
+void sleep_disable(void);
+void sleep_cpu(void);
+
+#endif
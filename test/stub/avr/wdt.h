@@ -0,0 +1,13 @@
+/* host stand-in for <avr/wdt.h> */
+#ifndef STUB_AVR_WDT_H
+#define STUB_AVR_WDT_H
+
+#define WDTO_15MS	0
+#define WDTO_60MS	2
+#define WDTO_2S		7
+
+void wdt_enable(int timeout);
+void wdt_disable(void);
+void wdt_reset(void);
+
+#endif
@@ -0,0 +1,10 @@
+/* host stand-in for oddebug.h, debug output is off */
+#ifndef STUB_ODDEBUG_H
+#define STUB_ODDEBUG_H
+
+#define DBG1(prefix, data, len)
+#define DBG2(prefix, data, len)
+
+void odDebugInit(void);
+
+#endif
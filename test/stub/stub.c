@@ -0,0 +1,82 @@
+/* definitions behind the stub headers. registers are plain variables a
+ * test sets before calling into main.c, usb and cpu calls do nothing
+ */
+#include <string.h>
+
+#define REG(n)		volatile uint8_t n;
+#define REG16(n)	volatile uint16_t n;
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+#include <avr/sleep.h>
+#include <util/delay.h>
+#include "usbdrv.h"
+#include "oddebug.h"
+
+static volatile uint16_t timer1;
+uint16_t timer1Step = 1;
+uint16_t timer1End;
+
+volatile uint16_t *timer1Access(void)
+{
+ static uint16_t seen;
+
+ if(timer1<seen)
+  timer1End=seen;		//set back since last access
+ timer1+=timer1Step;
+ seen=timer1;
+ return &timer1;
+}
+
+uint8_t eepromImage[E2END+1];
+
+uint8_t eeprom_read_byte(const uint8_t *p)
+{
+ return eepromImage[(uintptr_t)p];
+}
+
+void eeprom_read_block(void *dst, const void *src, unsigned n)
+{
+ memcpy(dst,&eepromImage[(uintptr_t)src],n);
+}
+
+uchar			*usbMsgPtr;
+uchar			usbConfiguration;
+volatile uchar	usbSofCount;
+volatile schar	usbRxLen;
+
+uchar			usbReport[8];
+uchar			usbReportLen;
+unsigned		usbReports;
+uchar			usbBusy;
+
+void usbInit(void){}
+void usbPoll(void){}
+
+int usbInterruptIsReady(void)
+{
+ return !usbBusy;
+}
+
+void usbSetInterrupt(uchar *data, uchar len)
+{
+ if(len>sizeof(usbReport))
+  len=sizeof(usbReport);
+ memcpy(usbReport,data,len);
+ usbReportLen=len;
+ usbReports++;
+}
+
+void sei(void){}
+void cli(void){}
+void set_sleep_mode(int mode){}
+void sleep_enable(void){}
+void sleep_disable(void){}
+void sleep_cpu(void){}
+void wdt_enable(int timeout){}
+void wdt_disable(void){}
+void wdt_reset(void){}
+void _delay_ms(double ms){}
+void _delay_us(double us){}
+void odDebugInit(void){}
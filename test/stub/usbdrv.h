@@ -0,0 +1,81 @@
+/* host stand-in for usbdrv.h: the part of the driver interface main.c
+ * uses. functions are in stub.c, interrupt reports end up in usbReport
+ */
+#ifndef STUB_USBDRV_H
+#define STUB_USBDRV_H
+
+#include <stdint.h>
+#include "usbconfig.h"
+
+typedef unsigned char	uchar;
+typedef signed char		schar;
+
+typedef union usbWord{
+    unsigned	word;
+    uchar		bytes[2];
+}usbWord_t;
+
+typedef struct usbRequest{
+    uchar		bmRequestType;
+    uchar		bRequest;
+    usbWord_t	wValue;
+    usbWord_t	wIndex;
+    usbWord_t	wLength;
+}usbRequest_t;
+
+#define USB_PUBLIC
+#define USB_NO_MSG		((usbMsgLen_t)-1)
+typedef uchar			usbMsgLen_t;
+
+extern uchar			*usbMsgPtr;
+extern uchar			usbConfiguration;
+extern volatile uchar	usbSofCount;
+extern volatile schar	usbRxLen;
+
+void	usbInit(void);
+void	usbPoll(void);
+int		usbInterruptIsReady(void);
+void	usbSetInterrupt(uchar *data, uchar len);
+uchar	usbFunctionSetup(uchar data[8]);
+
+/* last report given to usbSetInterrupt(), and how many there were.
+ * usbBusy set makes usbInterruptIsReady() say no
+ */
+extern uchar			usbReport[8];
+extern uchar			usbReportLen;
+extern unsigned			usbReports;
+extern uchar			usbBusy;
+
+#define USBIN			PIND
+#define USBOUT			PORTD
+#define USBDDR			DDRD
+#define USBMINUS		USB_CFG_DMINUS_BIT
+#define USBPLUS			USB_CFG_DPLUS_BIT
+#define USBMASK			((1<<USB_CFG_DPLUS_BIT) | (1<<USB_CFG_DMINUS_BIT))
+
+#define USB_INTR_CFG			MCUCR
+#define USB_INTR_ENABLE			GICR
+#define USB_INTR_PENDING		GIFR
+#define USB_INTR_PENDING_BIT	INTF0
+
+#define USB_PROP_LENGTH(len)	((len) & 0x3fff)
+
+#define USBRQ_TYPE_MASK			0x60
+#define USBRQ_TYPE_STANDARD		(0<<5)
+#define USBRQ_TYPE_CLASS		(1<<5)
+#define USBRQ_TYPE_VENDOR		(2<<5)
+
+#define USBRQ_HID_GET_REPORT	0x01
+#define USBRQ_HID_GET_IDLE		0x02
+#define USBRQ_HID_SET_REPORT	0x09
+#define USBRQ_HID_SET_IDLE		0x0a
+
+#define USBDESCR_CONFIG			2
+#define USBDESCR_INTERFACE		4
+#define USBDESCR_ENDPOINT		5
+#define USBDESCR_HID			0x21
+
+#define USBATTR_SELFPOWER		0x40
+#define USBATTR_REMOTEWAKE		0x20
+
+#endif
@@ -0,0 +1,19 @@
+/* host stand-in for <util/crc16.h>, same crc8 as avr-libc: polynomial
+ * x^8+x^2+x+1, msb first, no final xor
+ */
+#ifndef STUB_UTIL_CRC16_H
+#define STUB_UTIL_CRC16_H
+
+#include <stdint.h>
+
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data)
+{
+ uint8_t i;
+
+ data^=crc;
+ for(i=0;i<8;i++)
+  data=(data&0x80) ? (data<<1)^0x07 : data<<1;
+ return data;
+}
+
+#endif
@@ -0,0 +1,8 @@
+/* host stand-in for <util/delay.h>, delays return at once */
+#ifndef STUB_UTIL_DELAY_H
+#define STUB_UTIL_DELAY_H
+
+void _delay_ms(double ms);
+void _delay_us(double us);
+
+#endif
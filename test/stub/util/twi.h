@@ -0,0 +1,21 @@
+/* host stand-in for <util/twi.h>, status codes main.c looks at */
+#ifndef STUB_UTIL_TWI_H
+#define STUB_UTIL_TWI_H
+
+#define TW_STATUS_MASK		0xf8
+#define TW_STATUS			(TWSR & TW_STATUS_MASK)
+
+#define TW_START			0x08
+#define TW_MR_SLA_ACK		0x40
+#define TW_MR_SLA_NACK		0x48
+#define TW_MR_DATA_ACK		0x50
+#define TW_MR_DATA_NACK		0x58
+#define TW_ST_SLA_ACK		0xa8
+#define TW_ST_DATA_ACK		0xb8
+#define TW_ST_DATA_NACK		0xc0
+#define TW_BUS_ERROR		0x00
+
+#define TW_READ				1
+#define TW_WRITE			0
+
+#endif
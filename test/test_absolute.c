@@ -0,0 +1,105 @@
+//options: MOUSE_ABSOLUTE=1
+//
+//report descriptor must describe the 6 byte absolute report, a touched
+//mouse pad sends its absTarget little endian, a busy endpoint keeps the
+//target for the next scan, and clicks keep the pointer where it is
+
+#include "check.h"
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+//bytes of input report 'id' after the id byte, from the descriptor items
+static unsigned reportBytes(uint8_t id)
+{
+ unsigned i=0, bits=0, size=0, count=0, current=0, data;
+ uint8_t item, length;
+
+ while(i<sizeof(usbHidReportDescriptor))
+  {
+   item=usbHidReportDescriptor[i];
+   length=(item&3)==3 ? 4 : item&3;
+   data=0;
+   if(length>=1)
+    data=(uint8_t)usbHidReportDescriptor[i+1];
+   if(length>=2)
+    data|=(uint8_t)usbHidReportDescriptor[i+2]<<8;
+
+   switch(item&0xfc)
+    {
+     case 0x84: current=data; break;		//REPORT_ID
+     case 0x74: size=data; break;			//REPORT_SIZE
+     case 0x94: count=data; break;			//REPORT_COUNT
+     case 0x80:								//INPUT
+      if(current==id)
+       bits+=size*count;
+      break;
+    }
+   i+=1+length;
+  }
+ CHECK(i==sizeof(usbHidReportDescriptor));	//no item cut off at the end
+ CHECK(bits%8==0);
+ return bits/8;
+}
+
+static void scan(uint8_t n)
+{
+ while(n--)
+  keyPressed();
+}
+
+static void checkTarget(uint8_t pad)
+{
+ uint16_t x=absTarget[pad-12][0], y=absTarget[pad-12][1];
+
+ CHECK(usbReportLen==6);
+ CHECK(usbReport[0]==2);
+ CHECK(usbReport[2]==(x&0xff) && usbReport[3]==x>>8);
+ CHECK(usbReport[4]==(y&0xff) && usbReport[5]==y>>8);
+}
+
+int main(void)
+{
+ unsigned reports;
+
+ CHECK(reportBytes(2)+1==sizeof(reportBufferMouse));
+ CHECK((uint8_t)usbHidReportDescriptor[sizeof(usbHidReportDescriptor)-1]==0xc0);
+
+ PINB=0xff;
+ PINC=0xff;
+ PIND=0xff;
+ configDefaults();
+
+ PIND&=~(1<<5);					//pad 15, right centre
+ while(!inputs[15].pressed)
+  keyPressed();
+ checkTarget(15);
+ CHECK(usbReport[1]==0);
+ PIND|=(1<<5);
+ scan(BUFFER_BYTES*8);
+
+ usbBusy=1;						//pad 12 meets a busy endpoint
+ PIND&=~(1<<1);
+ while(!inputs[12].pressed)
+  keyPressed();
+ reports=usbReports;
+ scan(3);
+ CHECK(usbReports==reports);
+ CHECK(pointerTarget==1);
+ usbBusy=0;
+ keyPressed();
+ CHECK(usbReports==reports+1);
+ checkTarget(12);
+ CHECK(pointerTarget==0);
+ PIND|=(1<<1);
+ scan(BUFFER_BYTES*8);
+
+ PIND&=~(1<<6);					//left click stays on bottom centre
+ while(!inputs[16].pressed)
+  keyPressed();
+ checkTarget(12);
+ CHECK(usbReport[1]==1);
+
+ return checkResult();
+}
@@ -0,0 +1,68 @@
+//options: ADAPTIVE_BASELINE=1
+//
+//pad 0 (PB0) leaks more and more while nobody touches it. baseline has
+//to follow, so the pad never presses on its own, has to settle on the
+//rounded idle level, and a real touch above it still presses
+
+#include "check.h"
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+static unsigned scan;
+
+//pad 0 reads touched on 'low' of every 'every' scans
+static void leak(uint8_t low, uint8_t every, unsigned scans)
+{
+ unsigned n;
+
+ for(n=0;n<scans;n++,scan++)
+  {
+   if(scan%every<low)
+    PINB&=~(1<<0);
+   else
+    PINB|=(1<<0);
+   keyPressed();
+   CHECK(!inputs[0].pressed);
+  }
+}
+
+static uint8_t roundedBaseline(void)
+{
+ return (inputs[0].baseline+(1<<(BASELINE_SHIFT-1)))>>BASELINE_SHIFT;
+}
+
+int main(void)
+{
+ uint8_t i;
+
+ PINB=0xff;
+ PINC=0xff;
+ PIND=0xff;
+ configDefaults();
+
+ leak(1,3,60000);				//8 of 24 samples
+ CHECK(roundedBaseline()==8);
+ leak(1,2,60000);				//12
+ CHECK(roundedBaseline()==12);
+ leak(2,3,60000);				//16, above press threshold of a dry pad
+ CHECK(roundedBaseline()==16);
+
+ PINB&=~(1<<0);					//touch
+ for(i=0;i<BUFFER_BYTES*8 && !inputs[0].pressed;i++)
+  keyPressed();
+ CHECK(inputs[0].pressed);
+
+ //held, baseline must not creep up to the touched level
+ for(i=0;i<200;i++)
+  keyPressed();
+ CHECK(roundedBaseline()==16);
+
+ PINB|=(1<<0);					//let go
+ for(i=0;i<BUFFER_BYTES*8 && inputs[0].pressed;i++)
+  keyPressed();
+ CHECK(!inputs[0].pressed);
+
+ return checkResult();
+}
@@ -0,0 +1,93 @@
+//options: BRIDGE_DETECT=1
+//
+//PB0 and PB1 shorted by one wet spot press on the same scan with the
+//same samples, only PB0 is a key. a second touch later or with its own
+//noise is a real chord. onset age stops at 255 on keys held long
+
+#include "check.h"
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+//keys in last keyboard report
+static uint8_t keysDown(void)
+{
+ uint8_t j, n=0;
+
+ for(j=2;j<8;j++)
+  if(reportBufferKeyboard[j])
+   n++;
+ return n;
+}
+
+static void letGo(void)
+{
+ uint8_t n;
+
+ PINB|=(1<<0)|(1<<1);
+ for(n=0;n<BUFFER_BYTES*8;n++)
+  keyPressed();
+ CHECK(!inputs[0].pressed && !inputs[1].pressed);
+ CHECK(!inputs[0].bridged && !inputs[1].bridged);
+ CHECK(keysDown()==0);
+}
+
+int main(void)
+{
+ unsigned n;
+
+ PINB=0xff;
+ PINC=0xff;
+ PIND=0xff;
+ configDefaults();
+
+ //bridge, both at once
+ PINB&=~((1<<0)|(1<<1));
+ while(!inputs[0].pressed)
+  keyPressed();
+ CHECK(inputs[1].pressed && inputs[1].bridged);
+ CHECK(!inputs[0].bridged);
+ CHECK(bridgeCount[0]==1);
+ CHECK(keysDown()==1);
+
+ for(n=0;n<300;n++)				//held long, age stops
+  {
+   keyPressed();
+   CHECK(inputs[0].age>=(n<255 ? n+1 : 255));
+  }
+ CHECK(inputs[0].age==255 && inputs[1].age==255);
+ letGo();
+
+ //second pad touched long after the first
+ PINB&=~(1<<0);
+ while(!inputs[0].pressed)
+  keyPressed();
+ for(n=0;n<BRIDGE_ONSET_SCANS;n++)
+  keyPressed();
+ PINB&=~(1<<1);
+ while(!inputs[1].pressed)
+  keyPressed();
+ CHECK(!inputs[1].bridged);
+ CHECK(keysDown()==2);
+ letGo();
+
+ //both at once but PB1 with its own noise
+ for(n=0;!inputs[1].pressed;n++)
+  {
+   PINB&=~(1<<0);
+   if(n%4==3)
+    PINB|=(1<<1);
+   else
+    PINB&=~(1<<1);
+   keyPressed();
+  }
+ CHECK(inputs[0].pressed && inputs[0].age<=BRIDGE_ONSET_SCANS);
+ CHECK(!inputs[1].bridged);
+ CHECK(keysDown()==2);
+ letGo();
+
+ CHECK(bridgeCount[0]==1);
+
+ return checkResult();
+}
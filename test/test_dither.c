@@ -0,0 +1,42 @@
+//dithered scan period must go through every lfsr state, stay within
+//SCAN_TICKS +-HUM_DITHER_TICKS and keep SCAN_TICKS on average
+
+#include "check.h"
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+int main(void)
+{
+ uint8_t seen[256]={0};
+ uint16_t n, lowest=0xffff, highest=0;
+ uint32_t sum=0;
+
+ PINB=0xff;
+ PINC=0xff;
+ PIND=0xff;
+ configDefaults();
+
+ for(n=0;n<255;n++)
+  {
+   keyPressed();
+   CHECK(ditherState!=0);
+   CHECK(!seen[ditherState]);	//no state twice within one lfsr period
+   seen[ditherState]=1;
+
+   if(scanPeriod<lowest)
+    lowest=scanPeriod;
+   if(scanPeriod>highest)
+    highest=scanPeriod;
+   sum+=scanPeriod;
+  }
+
+ CHECK(lowest>=SCAN_TICKS-HUM_DITHER_TICKS);
+ CHECK(highest<=SCAN_TICKS+HUM_DITHER_TICKS);
+ CHECK(lowest<SCAN_TICKS-HUM_DITHER_TICKS*3/4);
+ CHECK(highest>SCAN_TICKS+HUM_DITHER_TICKS*3/4);
+ CHECK(sum/255>=SCAN_TICKS-2 && sum/255<=SCAN_TICKS+2);
+
+ return checkResult();
+}
@@ -0,0 +1,73 @@
+//options: FILTER_EMA=1
+//
+//exponential average must reach both ends and never wrap, its level
+//must land on the window scale, and a pad must press and release in
+//no more scans than the 24 bit window takes
+
+#include "check.h"
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+int main(void)
+{
+ uint16_t a;
+ uint8_t i, next, highest;
+ uint16_t sum;
+
+ for(a=0;a<256;a++)
+  {
+   next=emaStep(a,1);
+   CHECK(next>=a);
+   CHECK(a==255 || next>a);		//no stall below the top
+   next=emaStep(a,0);
+   CHECK(next<=a);
+   CHECK(a==0 || next<a);		//no stall above the bottom
+  }
+
+ inputs[0].average=0;
+ for(i=0;i<60;i++)
+  inputs[0].average=emaStep(inputs[0].average,1);
+ CHECK(inputs[0].average==255);
+ CHECK(filterLevel(0)==BUFFER_BYTES*8);
+
+ for(i=0;i<60;i++)
+  inputs[0].average=emaStep(inputs[0].average,0);
+ CHECK(inputs[0].average==0);
+ CHECK(filterLevel(0)==0);
+
+ //touched on 1 of 3 samples, window would read 8
+ for(i=0;i<90;i++)
+  inputs[0].average=emaStep(inputs[0].average,i%3==0);
+ highest=0;
+ sum=0;
+ for(i=0;i<90;i++)
+  {
+   inputs[0].average=emaStep(inputs[0].average,i%3==0);
+   if(filterLevel(0)>highest)
+    highest=filterLevel(0);
+   sum+=filterLevel(0);
+  }
+ CHECK(sum/90>=7 && sum/90<=9);
+ CHECK(highest<PRESS_THRESHOLD);
+
+ PINB=0xff;
+ PINC=0xff;
+ PIND=0xff;
+ configDefaults();
+ inputs[0].average=0;
+
+ PINB&=~(1<<0);					//touch pad 0
+ for(i=0;i<BUFFER_BYTES*8 && !inputs[0].pressed;i++)
+  keyPressed();
+ CHECK(inputs[0].pressed);
+ CHECK(i<BUFFER_BYTES*8/2);		//window needs 15 scans
+
+ PINB|=(1<<0);
+ for(i=0;i<BUFFER_BYTES*8 && inputs[0].pressed;i++)
+  keyPressed();
+ CHECK(!inputs[0].pressed);
+
+ return checkResult();
+}
@@ -0,0 +1,82 @@
+//options: FAST_ATTACK=1
+//
+//a run of FAST_ATTACK_RUN touched samples presses at once, a shorter
+//burst does not, raiseFilter() keeps bufferSum equal to the ones in
+//the window, and release still waits for the filter hysteresis
+
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+static uint8_t ones(uint8_t i)
+{
+ uint8_t j, n=0, byte;
+
+ for(j=0;j<BUFFER_BYTES;j++)
+  for(byte=inputs[i].measurementBuffer[j];byte;byte&=byte-1)
+   n++;
+ return n;
+}
+
+static void idle(void)
+{
+ uint8_t i;
+
+ PINB|=(1<<0);
+ for(i=0;i<BUFFER_BYTES*8;i++)
+  keyPressed();
+}
+
+int main(void)
+{
+ uint8_t i, j, level, before[BUFFER_BYTES];
+ unsigned n;
+
+ srand(1);
+ for(n=0;n<10000;n++)
+  {
+   for(j=0;j<BUFFER_BYTES;j++)
+    before[j]=inputs[1].measurementBuffer[j]=rand();
+   inputs[1].bufferSum=ones(1);
+   level=rand()%(BUFFER_BYTES*8+1);
+   raiseFilter(1,level);
+   CHECK(inputs[1].bufferSum==ones(1));
+   CHECK(inputs[1].bufferSum>=level);
+   for(j=0;j<BUFFER_BYTES;j++)
+    CHECK((inputs[1].measurementBuffer[j]&before[j])==before[j]);
+  }
+ memset(inputs,0,sizeof(inputs));
+
+ PINB=0xff;
+ PINC=0xff;
+ PIND=0xff;
+ configDefaults();
+
+ PINB&=~(1<<0);					//burst one short of a run
+ for(i=0;i<FAST_ATTACK_RUN-1;i++)
+  keyPressed();
+ CHECK(!inputs[0].pressed);
+ idle();
+ CHECK(!inputs[0].pressed);
+
+ PINB&=~(1<<0);
+ for(i=0;i<FAST_ATTACK_RUN-1;i++)
+  keyPressed();
+ CHECK(!inputs[0].pressed);
+ keyPressed();
+ CHECK(inputs[0].pressed);
+ CHECK(inputs[0].bufferSum==ones(0));
+
+ PINB|=(1<<0);					//one idle sample is inside the hysteresis
+ keyPressed();
+ CHECK(inputs[0].pressed);
+ for(i=0;i<BUFFER_BYTES*8 && inputs[0].pressed;i++)
+  keyPressed();
+ CHECK(!inputs[0].pressed);
+
+ return checkResult();
+}
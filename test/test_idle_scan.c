@@ -0,0 +1,38 @@
+//options: HUM_DITHER=0
+//
+//after IDLE_SCANS scans without any touched sample the scan period is
+//IDLE_SCAN_FACTOR times longer, and the first touched sample brings back
+//full rate for the wait right after it
+
+#include "check.h"
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+int main(void)
+{
+ uint16_t n;
+
+ PINB=0xff;
+ PINC=0xff;
+ PIND=0xff;
+ configDefaults();
+
+ for(n=0;n<IDLE_SCANS-1;n++)
+  {
+   keyPressed();
+   CHECK(scanPeriod==SCAN_TICKS+1);
+  }
+ keyPressed();
+ CHECK(scanPeriod==SCAN_TICKS*IDLE_SCAN_FACTOR+1);	//scan number IDLE_SCANS
+
+ PIND&=~(1<<7);					//one sample of pad 17
+ keyPressed();
+ CHECK(scanPeriod==SCAN_TICKS+1);
+ PIND|=(1<<7);
+ keyPressed();
+ CHECK(scanPeriod==SCAN_TICKS+1);
+
+ return checkResult();
+}
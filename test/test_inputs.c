@@ -0,0 +1,89 @@
+//input enable mask: scan goes only through enabled inputs which passed
+//self test, a disabled pad never presses, one disabled while held stays
+//until it released so its key is not stuck, and it starts clean when
+//enabled again
+
+#include "check.h"
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+static void setInputs(uint32_t mask)
+{
+ usbRequest_t rq={USBRQ_TYPE_VENDOR,VENDOR_RQ_SET_INPUTS};
+
+ rq.wValue.word=mask&0xffff;
+ rq.wIndex.word=mask>>16;
+ usbFunctionSetup((uchar *)&rq);
+}
+
+static uint8_t listed(uint8_t i)
+{
+ uint8_t n;
+
+ for(n=0;n<activeCount;n++)
+  if(activeList[n]==i)
+   return 1;
+ return 0;
+}
+
+static void scan(uint8_t n)
+{
+ while(n--)
+  keyPressed();
+}
+
+int main(void)
+{
+ uint8_t i;
+
+ PINB=0xff;
+ PINC=0xff;
+ PIND=0xff;
+ configDefaults();
+
+ keyPressed();
+ CHECK(activeCount==TOTAL_KEYS);
+ for(i=0;i<TOTAL_KEYS;i++)
+  CHECK(activeList[i]==i);
+
+ setInputs(0xffffffffUL&~(1UL<<0));	//bits above input 17 are dropped
+ CHECK(config.inputEnable[2]==0x03);
+ keyPressed();
+ CHECK(activeCount==TOTAL_KEYS-1 && !listed(0));
+ PINB&=~(1<<0);
+ scan(BUFFER_BYTES*8);
+ CHECK(!inputs[0].pressed && inputs[0].bufferSum==0);
+
+ PINB&=~(1<<1);					//pad 1 disabled while held
+ while(!inputs[1].pressed)
+  keyPressed();
+ CHECK(reportBufferKeyboard[2]==config.keymap[1]);
+ setInputs(INPUT_ENABLE_DEFAULT&~3UL);
+ scan(3);
+ CHECK(inputs[1].pressed && listed(1));
+ PINB|=(1<<1);
+ while(inputs[1].pressed)
+  keyPressed();
+ CHECK(reportBufferKeyboard[2]==0);
+ keyPressed();
+ CHECK(!listed(1) && activeCount==TOTAL_KEYS-2);
+ CHECK(inputs[1].bufferSum==0);
+
+ setInputs(INPUT_ENABLE_DEFAULT);	//pad 0 still touched, starts from empty
+ keyPressed();
+ CHECK(activeCount==TOTAL_KEYS);
+ CHECK(inputs[0].bufferSum==1 && !inputs[0].pressed);
+ while(!inputs[0].pressed)
+  keyPressed();
+ PINB|=(1<<0);
+ scan(BUFFER_BYTES*8);
+
+ inputStatus(5)=INPUT_SHORTED;	//self test wins over enable mask
+ setInputs(INPUT_ENABLE_DEFAULT);
+ keyPressed();
+ CHECK(!listed(5) && activeCount==TOTAL_KEYS-1);
+
+ return checkResult();
+}
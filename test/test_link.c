@@ -0,0 +1,127 @@
+//options: LINK_MODE=LINK_PRIMARY
+//
+//primary reads one secondary per linkTask() run and merges its pads into
+//the keyboard report by linkKeymap. bad crc keeps what the board had,
+//LINK_LOST bad or unchanged frames release its keys, and a report the
+//busy endpoint did not take goes out on a later run
+
+#include "check.h"
+#include <avr/io.h>
+
+//TWSR reads play the secondaries on the bus for the step TWCR asked for
+static volatile uint8_t *twiStatus(void);
+#define TWSR	(*twiStatus())
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+static uchar boardFrame[LINK_BOARDS][LINK_FRAME];
+static uint8_t boardThere[LINK_BOARDS];
+static uint8_t twiBoard, twiByte;
+
+static volatile uint8_t *twiStatus(void)
+{
+ static volatile uint8_t status;
+
+ if(TWCR&(1<<TWSTA))
+  {
+   status=TW_START;
+   twiBoard=0xff;
+  }
+ else if(twiBoard==0xff)
+  {
+   twiBoard=(TWDR>>1)-LINK_ADDRESS;
+   twiByte=0;
+   status=(twiBoard<LINK_BOARDS && boardThere[twiBoard]) ? TW_MR_SLA_ACK : TW_MR_SLA_NACK;
+  }
+ else
+  {
+   TWDR=boardFrame[twiBoard][twiByte++];
+   status=(TWCR&(1<<TWEA)) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+  }
+ return &status;
+}
+
+static void setFrame(uint8_t b, uchar seq, uint32_t bits)
+{
+ boardFrame[b][0]=seq;
+ boardFrame[b][1]=bits;
+ boardFrame[b][2]=bits>>8;
+ boardFrame[b][3]=bits>>16;
+ boardFrame[b][4]=linkCrc(boardFrame[b]);
+}
+
+//one read of every board
+static void readAll(void)
+{
+ uint8_t b;
+
+ for(b=0;b<LINK_BOARDS;b++)
+  linkTask();
+}
+
+static uint8_t inReport(uchar code)
+{
+ uint8_t j;
+
+ for(j=2;j<8;j++)
+  if(reportBufferKeyboard[j]==code)
+   return 1;
+ return 0;
+}
+
+int main(void)
+{
+ uint8_t n;
+ unsigned reports;
+
+ timer1Step=0;					//no step times out
+ boardThere[0]=1;
+
+ setFrame(0,1,(1UL<<0)|(1UL<<17));	//board 1 is not there
+ readAll();
+ CHECK(linkBoard==0);
+ CHECK(inReport(pgm_read_byte(&linkKeymap[0][0])));
+ CHECK(inReport(pgm_read_byte(&linkKeymap[0][17])));
+ CHECK(usbReport[0]==1 && usbReports==1);
+ CHECK(linkStats[0].frames==1 && linkStats[0].errors==0);
+ CHECK(linkStats[1].frames==0 && linkStats[1].errors==1);
+
+ setFrame(0,2,1UL<<0);			//pad 17 let go
+ readAll();
+ CHECK(inReport(pgm_read_byte(&linkKeymap[0][0])));
+ CHECK(!inReport(pgm_read_byte(&linkKeymap[0][17])));
+ CHECK(usbReports==2);
+
+ boardFrame[0][0]=3;			//crc wrong, board keeps its keys
+ readAll();
+ CHECK(linkStats[0].errors==1 && linkStats[0].lostInRow==1);
+ CHECK(inReport(pgm_read_byte(&linkKeymap[0][0])));
+ CHECK(usbReports==2);
+
+ setFrame(0,3,1UL<<0);			//good again, then stops scanning
+ readAll();
+ CHECK(linkStats[0].lostInRow==0);
+ for(n=0;n<LINK_LOST-1;n++)
+  readAll();
+ CHECK(linkStats[0].lostInRow==LINK_LOST-1);
+ CHECK(inReport(pgm_read_byte(&linkKeymap[0][0])));
+ readAll();
+ CHECK(linkStats[0].lostInRow==LINK_LOST);
+ CHECK(!inReport(pgm_read_byte(&linkKeymap[0][0])));
+ CHECK(usbReports==3);
+
+ usbBusy=1;						//board back, endpoint busy
+ setFrame(0,4,1UL<<5);
+ readAll();
+ CHECK(linkStats[0].lostInRow==0);
+ CHECK(linkDirty && usbReports==3);
+ usbBusy=0;
+ reports=usbReports;
+ readAll();
+ CHECK(!linkDirty && usbReports==reports+1);
+ CHECK(inReport(pgm_read_byte(&linkKeymap[0][5])));
+
+ return checkResult();
+}
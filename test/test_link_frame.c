@@ -0,0 +1,57 @@
+//options: LINK_MODE=LINK_SECONDARY
+//
+//secondary board puts sequence, pressed bits and crc8 into linkFrame
+//every scan, and a read of the primary gets the frame of address
+//match even when a scan changes linkFrame in the middle of it
+
+#include "check.h"
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+int main(void)
+{
+ uchar known[LINK_FRAME]="1234";
+ uchar seq, sent[LINK_FRAME];
+ uint8_t i, scans=0;
+
+ CHECK(linkCrc(known)==0xc2);	//crc-8, polynomial 0x07, of "1234"
+
+ PINB=0xff;
+ PINC=0xff;
+ PIND=0xff;
+ configDefaults();
+
+ keyPressed();
+ seq=linkFrame[0];
+ CHECK(linkFrame[1]==0 && linkFrame[2]==0 && linkFrame[3]==0);
+ CHECK(linkFrame[4]==linkCrc((uchar *)linkFrame));
+
+ PINB&=~(1<<0);					//pads 0, 9 and 17
+ PINC&=~(1<<3);
+ PIND&=~(1<<7);
+ for(;!inputs[0].pressed;scans++)
+  keyPressed();
+ CHECK((uchar)(linkFrame[0]-seq)==scans);		//one frame per scan
+ CHECK(linkFrame[1]==0x01 && linkFrame[2]==0x02 && linkFrame[3]==0x02);
+ CHECK(linkFrame[4]==linkCrc((uchar *)linkFrame));
+
+ for(i=0;i<LINK_FRAME;i++)
+  sent[i]=linkFrame[i];
+
+ TWSR=TW_ST_SLA_ACK;			//primary reads while we scan on
+ TWI_vect();
+ CHECK(TWDR==sent[0]);
+ for(i=1;i<LINK_FRAME;i++)
+  {
+   keyPressed();
+   CHECK(linkFrame[0]!=sent[0]);
+   TWSR=TW_ST_DATA_ACK;
+   TWI_vect();
+   CHECK(TWDR==sent[i]);
+   CHECK(TWCR&(1<<TWEA));
+  }
+
+ return checkResult();
+}
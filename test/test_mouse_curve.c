@@ -0,0 +1,83 @@
+//mouse acceleration follows held time, not the number of scans: the
+//same hold at 0.75ms and at 3ms per scan reaches the same curve step,
+//speed stops at the end of the curve and release starts it over. motion
+//below one count is carried, sent counts plus what is left are exactly
+//what the speeds added up to
+
+#include "check.h"
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+static int32_t moved, speedSum;
+
+//one scan 'ticks' after the last, adds up what the report moved
+static void scan(uint16_t ticks)
+{
+ unsigned reports=usbReports;
+
+ TCNT1=TCNT1+ticks;
+ keyPressed();
+ if(usbReports!=reports && usbReport[0]==2 && xPositive)
+  {
+   moved+=(int8_t)usbReport[2];
+   speedSum+=mouseSpeed;
+  }
+}
+
+//hold pad 15 (x+) for 'ms' after it pressed, one scan every 'ticks'
+static uint8_t hold(uint16_t ticks, uint16_t ms)
+{
+ uint32_t held=0;
+
+ moved=speedSum=0;
+ PIND&=~(1<<5);
+ while(!inputs[15].pressed)
+  scan(ticks);
+ while(held<ms*1500UL)
+  {
+   scan(ticks);
+   held+=ticks;
+   CHECK(mouseSpeed>=1 && mouseSpeed<=MOUSE_MAX_SPEED<<MOUSE_FRACTION_BITS);
+  }
+ CHECK(moved*(1<<MOUSE_FRACTION_BITS)+mouseFractionX==speedSum);
+ CHECK(mouseFractionX>=0 && mouseFractionX<1<<MOUSE_FRACTION_BITS);
+ return mouseStep;
+}
+
+static void letGo(uint16_t ticks)
+{
+ PIND|=(1<<5);
+ while(inputs[15].pressed || xPositive)
+  scan(ticks);
+ scan(ticks);
+}
+
+int main(void)
+{
+ uint8_t fast, slow;
+
+ timer1Step=0;					//time moves only when set
+ PINB=0xff;
+ PINC=0xff;
+ PIND=0xff;
+ configDefaults();
+
+ fast=hold(1125,1000);
+ letGo(1125);
+ CHECK(mouseStep==0 && mouseFractionX==0);
+
+ slow=hold(4500,1000);
+ letGo(4500);
+ CHECK(mouseStep==0 && mouseFractionX==0);
+
+ CHECK(fast>=9 && fast<=11);	//one step per 100ms
+ CHECK(fast==slow || fast==slow+1 || fast+1==slow);
+
+ hold(1125,10000);
+ CHECK(mouseStep==sizeof(mouseCurve)/sizeof(mouseCurve[0])-1);
+ CHECK(mouseSpeed==MOUSE_MAX_SPEED<<MOUSE_FRACTION_BITS);
+
+ return checkResult();
+}
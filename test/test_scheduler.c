@@ -0,0 +1,157 @@
+//runTasks() with the real periods, deadlines and budgets but tasks that
+//only take time: one task per call in priority order, late starts do
+//not add up, a missed deadline starts over from now, usbRxLen runs usb
+//early, and no task is missed when all are due at once and each takes
+//its whole budget
+
+#include <string.h>
+#include "check.h"
+
+#define main firmwareMain		//main.c brings its own
+#include "main.c"
+#undef main
+
+static uint16_t cost[TASKS];
+static unsigned runs[TASKS];
+static uint8_t last, once;
+
+static void fake(uint8_t i)
+{
+ runs[i]++;
+ last=i;
+ TCNT1=TCNT1+cost[i];
+ if(once)
+  cost[i]=0;
+}
+
+static void fakeUsb(void)		{ fake(TASK_USB); }
+static void fakeScan(void)		{ fake(TASK_SCAN); }
+static void fakeConfig(void)	{ fake(TASK_CONFIG); }
+static void fakeIdle(void)		{ fake(TASK_IDLE); }
+
+//every task started at 'now', or is due at 'now' with 'due' set
+static void restart(uint16_t now, uint8_t due)
+{
+ uint8_t i;
+
+ TCNT1=now;
+ for(i=0;i<TASKS;i++)
+  tasks[i].lastRun=due ? now-tasks[i].period : now;
+ memset(taskStats,0,sizeof(taskStats));
+ memset(runs,0,sizeof(runs));
+ memset(cost,0,sizeof(cost));
+ last=0xff;
+}
+
+//one call of runTasks(), returns task that ran or 0xff
+static uint8_t step(void)
+{
+ last=0xff;
+ runTasks();
+ return last;
+}
+
+int main(void)
+{
+ uint8_t i;
+ uint16_t start, first=0xffff;
+ uint32_t t;
+
+ timer1Step=0;					//time moves only when set
+ tasks[TASK_USB].run=fakeUsb;
+ tasks[TASK_SCAN].run=fakeScan;
+ tasks[TASK_CONFIG].run=fakeConfig;
+ tasks[TASK_IDLE].run=fakeIdle;
+
+ //nothing due, compare match is set for the first one that will be
+ restart(0,0);
+ CHECK(step()==0xff);
+ for(i=0;i<TASKS;i++)
+  if(tasks[i].period<first)
+   first=tasks[i].period;
+ CHECK(OCR1A==first);
+
+ //late within deadline, next start stays on the period grid
+ restart(0,0);
+ TCNT1=TASK_USB_PERIOD+TASK_USB_DEADLINE-1;
+ CHECK(step()==TASK_USB);
+ CHECK(tasks[TASK_USB].lastRun==TASK_USB_PERIOD);
+ CHECK(taskStats[TASK_USB].missed==0);
+
+ //missed deadline, counted and next period is from now
+ restart(0,0);
+ TCNT1=TASK_USB_PERIOD+TASK_USB_DEADLINE+1;
+ CHECK(step()==TASK_USB);
+ CHECK(tasks[TASK_USB].lastRun==TASK_USB_PERIOD+TASK_USB_DEADLINE+1);
+ CHECK(taskStats[TASK_USB].missed==1);
+
+ //same across the timer1 wrap
+ restart(0xffff-TASK_USB_PERIOD/2,0);
+ start=TCNT1;
+ TCNT1=start+TASK_USB_PERIOD+10;
+ CHECK(step()==TASK_USB);
+ CHECK(tasks[TASK_USB].lastRun==(uint16_t)(start+TASK_USB_PERIOD));
+ CHECK(taskStats[TASK_USB].missed==0);
+
+ //received packet runs usb early and keeps its period
+ restart(0,0);
+ TCNT1=100;
+ usbRxLen=3;
+ CHECK(step()==TASK_USB);
+ CHECK(tasks[TASK_USB].lastRun==0);
+ usbRxLen=0;
+
+ //everything due, one task per call, usb first
+ restart(TASK_IDLE_PERIOD,1);
+ CHECK(step()==TASK_USB);
+ CHECK(step()==TASK_SCAN);
+ CHECK(step()==TASK_CONFIG);
+ CHECK(step()==TASK_IDLE);
+
+ //run over budget is counted, longest run kept
+ restart(0,0);
+ cost[TASK_USB]=TASK_USB_BUDGET+1;
+ TCNT1=TASK_USB_PERIOD;
+ step();
+ CHECK(taskStats[TASK_USB].overruns==1);
+ CHECK(taskStats[TASK_USB].worst==TASK_USB_BUDGET+1);
+
+ //all due at once and each takes its whole budget once, the last one
+ //still starts within its deadline
+ restart(0,1);
+ once=1;
+ cost[TASK_USB]=TASK_USB_BUDGET;
+ cost[TASK_SCAN]=TASK_SCAN_BUDGET;
+ cost[TASK_CONFIG]=TASK_CONFIG_BUDGET;
+ cost[TASK_IDLE]=TASK_IDLE_BUDGET;
+ for(i=0;i<2*TASKS && !runs[TASK_IDLE];i++)
+  step();						//usb comes round again in between
+ for(i=0;i<TASKS;i++)
+  {
+   CHECK(runs[i]>=1);
+   CHECK(taskStats[i].missed==0);
+  }
+ once=0;
+
+ //10s with each task taking half its budget, none missed and usb keeps
+ //its rate
+ restart(0,0);
+ cost[TASK_USB]=TASK_USB_BUDGET/2;
+ cost[TASK_SCAN]=TASK_SCAN_BUDGET/2;
+ cost[TASK_CONFIG]=TASK_CONFIG_BUDGET/2;
+ cost[TASK_IDLE]=TASK_IDLE_BUDGET/2;
+ for(t=0;t<15000000UL;)
+  {
+   start=TCNT1;
+   if(step()==0xff)
+    TCNT1=OCR1A;				//slept until compare match
+   t+=(uint16_t)(TCNT1-start);
+  }
+ for(i=0;i<TASKS;i++)
+  CHECK(taskStats[i].missed==0);
+ CHECK(runs[TASK_USB]>=15000000UL/TASK_USB_PERIOD-1);
+ CHECK(runs[TASK_USB]<=15000000UL/TASK_USB_PERIOD+1);
+ CHECK(runs[TASK_IDLE]>=15000000UL/TASK_IDLE_PERIOD-1);
+
+ return checkResult();
+}
@@ -171,6 +171,11 @@ section at the end of this file).
 /* This macro (if defined) is executed when a USB SET_ADDRESS request was
  * received.
  */
+/* #define USB_DEVICE_STATUS_HOOK()            (remoteWakeupEnabled ? 2 : 0) */
+/* This macro (if defined) gives bits which are ORed into the reply to a
+ * GET_STATUS request for the device, e.g. bit 1 while the host has enabled
+ * remote wakeup.
+ */
 #define USB_COUNT_SOF                   0
 /* define this macro to 1 if you need the global variable "usbSofCount" which
  * counts SOF packets. This feature requires that the hardware interrupt is
@@ -23,7 +23,13 @@ the newest features and options.
 
 /* ---------------------------- Hardware Config ---------------------------- */
 
-#define USB_CFG_CLOCK_KHZ       12000//(F_CPU/1000)
+#ifndef F_CPU
+#define F_CPU                   12000000UL
+#endif
+#define USB_CFG_CLOCK_KHZ       (F_CPU/1000)
+/* Clock rate of the AVR in kHz, follows F_CPU from the Makefile. usbdrvasm.S
+ * picks usbdrvasm12/15/16/20.inc by it.
+ */
 
 #define USB_CFG_IOPORTNAME      D
 /* This is the port where the USB bus is connected. When you configure it to
@@ -37,6 +43,8 @@ the newest features and options.
 /* This is the bit number in USB_CFG_IOPORT where the USB D+ line is connected.
  * This may be any bit in the port. Please note that D+ must also be connected
  * to interrupt pin INT0!
+ * If USB_COUNT_SOF is enabled below, swap the wiring (D- to PD2/INT0, D+ to
+ * PD0) and the two bit numbers.
  */
 
 /* ----------------------- Optional Hardware Config ------------------------ */
@@ -106,6 +114,30 @@ the newest features and options.
  * usbdrv.h.
  */
 
+#define USB_COUNT_SOF                   0
+/* Define this to 1 if you need the global variable "usbSofCount" which counts
+ * SOF packets (keep-alive on low speed). It needs the interrupt on D-, see
+ * USB_CFG_DPLUS_BIT above. The keys firmware uses it to detect host suspend,
+ * power down and wake the host with remote wakeup (USB_SUSPEND in main.c).
+ */
+#if USB_COUNT_SOF
+#if USB_CFG_DMINUS_BIT != 2
+#error "USB_COUNT_SOF needs D- on INT0 (PD2), swap the wiring and the bit numbers above"
+#endif
+#ifndef __ASSEMBLER__
+extern unsigned char    usbRemoteWakeup;
+#endif
+#define USB_RX_USER_HOOK(data, len)     if(usbRxToken == (uchar)USBPID_SETUP && data[0] == 0 && data[2] == 1 && (data[1] == 1 || data[1] == 3)) usbRemoteWakeup = (data[1] == 3);
+/* Remember whether the host has enabled remote wakeup with SET_FEATURE /
+ * CLEAR_FEATURE (DEVICE_REMOTE_WAKEUP). The driver does not handle this
+ * feature itself.
+ */
+#define USB_DEVICE_STATUS_HOOK()        (usbRemoteWakeup ? 2 : 0)
+/* GET_STATUS for the device reports remote wakeup (bit 1) as enabled while
+ * the host has it on.
+ */
+#endif
+
 /* -------------------------- Device Description --------------------------- */
 
 /* We cannot use Obdev's free shared VID/PID pair because this is a HID.
@@ -164,7 +196,16 @@ the newest features and options.
 /* See USB specification if you want to conform to an existing device class or
  * protocol.
  */
-#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    89//37//35  /* total length of report descriptor */
+#define HID_GAMEPAD                     0
+/* Define this to 1 to present the keys as one gamepad with 18 buttons instead
+ * of keyboard and mouse. All pads then go out in a single 3 byte report
+ * whenever any of them changes, so there is no 6 key limit.
+ */
+#if HID_GAMEPAD
+#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    49  /* gamepad, see main.c */
+#else
+#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    113//91//89//37//35  /* total length of report descriptor */
+#endif
 /* Define this to the length of the HID report descriptor, if you implement
  * an HID device. Otherwise don't define it or define it to 0.
  */
@@ -214,7 +255,11 @@ the newest features and options.
  */
 
 #define USB_CFG_DESCR_PROPS_DEVICE                  0
+#if USB_COUNT_SOF
+#define USB_CFG_DESCR_PROPS_CONFIGURATION           USB_PROP_LENGTH(34) /* main.c, advertises remote wakeup */
+#else
 #define USB_CFG_DESCR_PROPS_CONFIGURATION           0
+#endif
 #define USB_CFG_DESCR_PROPS_STRINGS                 0
 #define USB_CFG_DESCR_PROPS_STRING_0                0
 #define USB_CFG_DESCR_PROPS_STRING_VENDOR           0
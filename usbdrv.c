@@ -283,6 +283,9 @@ USB_PUBLIC void usbSetInterrupt3(uchar *data, uchar len)
 #ifndef USB_SET_ADDRESS_HOOK
 #define USB_SET_ADDRESS_HOOK()
 #endif
+#ifndef USB_DEVICE_STATUS_HOOK
+#define USB_DEVICE_STATUS_HOOK()    0
+#endif
 
 /* ------------------------------------------------------------------------- */
 
@@ -372,6 +375,8 @@ uchar   index = rq->wIndex.bytes[0];
         uchar recipient = rq->bmRequestType & USBRQ_RCPT_MASK;  /* assign arith ops to variables to enforce byte size */
         if(USB_CFG_IS_SELF_POWERED && recipient == USBRQ_RCPT_DEVICE)
             dataPtr[0] =  USB_CFG_IS_SELF_POWERED;
+        if(recipient == USBRQ_RCPT_DEVICE)
+            dataPtr[0] |= USB_DEVICE_STATUS_HOOK();
 #if USB_CFG_IMPLEMENT_HALT
         if(recipient == USBRQ_RCPT_ENDPOINT && index == 0x81)   /* request status for endpoint 1 */
             dataPtr[0] = usbTxLen1 == USBPID_STALL;
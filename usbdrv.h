@@ -364,8 +364,11 @@ extern uchar    usbCurrentDataToken;
 /* This macro builds a descriptor header for a string descriptor given the
  * string's length. See usbdrv.c for an example how to use it.
  */
-#if USB_CFG_HAVE_FLOWCONTROL
 extern volatile schar   usbRxLen;
+/* Number of bytes the receive interrupt has left in the buffer, 0 if none.
+ * The application may read it to find out whether usbPoll() has work.
+ */
+#if USB_CFG_HAVE_FLOWCONTROL
 #define usbDisableAllRequests()     usbRxLen = -1
 /* Must be called from usbFunctionWrite(). This macro disables all data input
  * from the USB interface. Requests from the host are answered with a NAK